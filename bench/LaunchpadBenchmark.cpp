@@ -0,0 +1,1020 @@
+// Benchmark of the MIDI input (parse and dispatch) and LED output paths of the
+// Launchpad trigger, run against an in-memory device rather than hardware.
+//
+// This builds the plugin source in to itself so that it can drive the
+// internal functions directly, and links against launchpad-core for the
+// models, parser and LED encoding just as the plugin does. It replaces the
+// ALSA backend with a loopback that we feed captured (or generated) MIDI in to
+// and count the output of.
+//
+// Usage: launchpad-benchmark [--triggers N[,N...]] [--show FILE]
+//                            [--capture FILE [--device N]] [--realtime]
+//                            [--verbose]
+//
+// Captures are either files recorded by the plugin (see "Record all MIDI" in
+// the global settings), of which only the device given by --device is used,
+// or text files with one event per line. Each line starts with the time in
+// microseconds from the start of the capture, followed by either the bytes
+// read from the device (in hex) or "replug" for the device being unplugged and
+// plugged back in, e.g.:
+//
+//     0 90 51 7f
+//     1500 a0 51 40 51 48
+//     9000 replug
+//
+// Shows are Stack show files, from which all the Launchpad triggers are used
+// (on our device, whichever device they were for). Without a show, synthetic
+// shows with the numbers of triggers given by --triggers are used
+
+// Includes:
+#include "../src/StackLaunchpadTrigger.cpp"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <stdarg.h>
+#include <string>
+
+// Definitions: The show sizes we run with by default
+static const size_t bench_default_trigger_counts[] = {10, 100, 1000, 5000};
+
+// Definitions: The number of full LED rebuilds (and of scene changes) we time
+// for each show size
+#define BENCH_UPDATE_REPEATS 200
+
+// Definitions: The numbers of buttons that the scene changes we time recolour
+static const size_t bench_scene_sizes[] = {5, 64};
+
+// Definitions: The number of times we parse the mixed stream
+#define BENCH_PARSE_REPEATS 200
+
+// Typedefs: An event in a capture
+typedef struct BenchEvent
+{
+	// When the event happened, relative to the start of the capture
+	stack_time_t time;
+
+	// Whether the device was unplugged and plugged back in (rather than
+	// bytes being read from it)
+	bool replug;
+
+	std::vector<unsigned char> data;
+} BenchEvent;
+
+// Typedefs: A named capture to replay
+typedef struct BenchCapture
+{
+	std::string name;
+	std::vector<BenchEvent> events;
+
+	// The number of bytes that were written to the device when the capture
+	// was recorded (if it was recorded by the plugin)
+	uint64_t bytes_written;
+} BenchCapture;
+
+// Typedefs: The state of our in-memory device. The handles of the device
+// point at this
+typedef struct BenchPort
+{
+	// Data waiting to be read, and when it arrived
+	std::deque<BenchEvent> input;
+	struct timespec input_time;
+
+	// Everything written to the device
+	uint64_t bytes_written;
+	uint64_t writes;
+} BenchPort;
+
+// Typedefs: Measurements from a run
+typedef struct BenchResult
+{
+	std::vector<stack_time_t> latencies;
+	uint64_t messages;
+	uint64_t flushes;
+	uint64_t bytes_written;
+	stack_time_t elapsed;
+} BenchResult;
+
+// The device that the loopback stands in for
+BenchPort bench_port;
+
+// Whether to show the log of the plugin
+bool bench_verbose = false;
+
+////////////////////////////////////////////////////////////////////////////////
+// HOST
+//
+// The plugin normally gets these from Stack. We only need enough of them for
+// the paths we benchmark, as no cues are ever run
+
+void stack_log(const char *format, ...)
+{
+	if (bench_verbose)
+	{
+		va_list args;
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+	}
+}
+
+stack_time_t stack_get_clock_time()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (stack_time_t)now.tv_sec * NANOSECS_PER_SEC + now.tv_nsec;
+}
+
+StackTriggerAction stack_trigger_get_action(StackTrigger *trigger)
+{
+	return STACK_TRIGGER_ACTION_PLAY;
+}
+
+void stack_trigger_init(StackTrigger *trigger, StackCue *cue) {}
+void stack_trigger_destroy_base(StackTrigger *trigger) {}
+void stack_trigger_from_json_base(StackTrigger *trigger, const char *json_data) {}
+bool stack_register_trigger_class(StackTriggerClass *trigger_class) { return true; }
+bool stack_json_read_string(const char *json_data, Json::Value *result)
+{
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	return reader->parse(json_data, json_data + strlen(json_data), result, NULL);
+}
+
+bool stack_cue_play(StackCue *cue) { return true; }
+void stack_cue_stop(StackCue *cue) {}
+void stack_cue_pause(StackCue *cue) {}
+StackProperty *stack_cue_get_property(StackCue *cue, const char *property) { return NULL; }
+void stack_property_set_double(StackProperty *property, StackPropertyVersion version, double value) {}
+void stack_cue_list_lock(StackCueList *cue_list) {}
+void stack_cue_list_unlock(StackCueList *cue_list) {}
+void stack_cue_list_stop_all(StackCueList *cue_list) {}
+StackAppWindow *saw_get_window_for_cue(StackCue *cue) { return NULL; }
+void stack_limit_gtk_entry_int(GtkEntry *entry, bool allow_negative) {}
+void stack_gtk_color_chooser_get_rgb(GtkColorChooser *chooser, uint8_t *r, uint8_t *g, uint8_t *b) {}
+
+////////////////////////////////////////////////////////////////////////////////
+// LOOPBACK BACKEND
+
+static bool stack_launchpad_bench_open(LaunchpadDevice *device, const char *address)
+{
+	device->handle_in = reinterpret_cast<snd_rawmidi_t*>(&bench_port);
+	device->handle_out = reinterpret_cast<snd_rawmidi_t*>(&bench_port);
+	device->poll_fds = {-1, POLLIN, 0};
+	device->timestamped = true;
+	snprintf(device->address, sizeof(device->address), "%s", address);
+	return true;
+}
+
+// Reads the next event that has been fed to the device
+static ssize_t stack_launchpad_bench_read(LaunchpadDevice *device, unsigned char *buffer, size_t size, struct timespec *timestamp)
+{
+	if (bench_port.input.size() == 0)
+	{
+		return -EAGAIN;
+	}
+
+	BenchEvent &event = bench_port.input.front();
+	const size_t length = std::min(size, event.data.size());
+	memcpy(buffer, event.data.data(), length);
+	*timestamp = bench_port.input_time;
+
+	// Leave anything that didn't fit for the next read
+	if (length < event.data.size())
+	{
+		event.data.erase(event.data.begin(), event.data.begin() + length);
+	}
+	else
+	{
+		bench_port.input.pop_front();
+	}
+
+	return length;
+}
+
+static ssize_t stack_launchpad_bench_write(snd_rawmidi_t *handle, const void *buffer, size_t size)
+{
+	bench_port.bytes_written += size;
+	bench_port.writes++;
+	return size;
+}
+
+static int stack_launchpad_bench_drain(snd_rawmidi_t *handle)
+{
+	return 0;
+}
+
+static int stack_launchpad_bench_close(snd_rawmidi_t *handle)
+{
+	return 0;
+}
+
+static const LaunchpadMidiBackend launchpad_bench_backend = {
+	stack_launchpad_bench_open,
+	stack_launchpad_bench_read,
+	stack_launchpad_bench_write,
+	stack_launchpad_bench_drain,
+	stack_launchpad_bench_close,
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// CAPTURES
+
+static void stack_launchpad_bench_add_event(BenchCapture *capture, stack_time_t time, std::initializer_list<unsigned char> data)
+{
+	capture->events.push_back({time, false, std::vector<unsigned char>(data)});
+}
+
+// Sixteenth notes at 200bpm, rolling around the grid, with velocity changing
+// as it goes
+static BenchCapture stack_launchpad_bench_make_roll()
+{
+	BenchCapture capture = {"roll", {}, 0};
+	const stack_time_t step = 75 * NANOSECS_PER_MILLISEC;
+	for (size_t i = 0; i < 4096; i++)
+	{
+		const unsigned char address = LaunchpadModelX::col_row_to_address(1 + i % 8, 2 + (i / 8) % 8);
+		stack_launchpad_bench_add_event(&capture, i * step, {MIDI_NOTE_ON, address, (unsigned char)(40 + i % 87)});
+		stack_launchpad_bench_add_event(&capture, i * step + step / 2, {MIDI_NOTE_ON, address, 0});
+	}
+
+	return capture;
+}
+
+// Eight buttons held down with their pressure changing constantly. The
+// device uses running status for these, so many come in a single read
+static BenchCapture stack_launchpad_bench_make_aftertouch()
+{
+	BenchCapture capture = {"aftertouch", {}, 0};
+	const stack_time_t step = 2 * NANOSECS_PER_MILLISEC;
+	for (size_t column = 1; column <= 8; column++)
+	{
+		stack_launchpad_bench_add_event(&capture, 0, {MIDI_NOTE_ON, LaunchpadModelX::col_row_to_address(column, 5), 100});
+	}
+	for (size_t i = 1; i <= 2048; i++)
+	{
+		BenchEvent event = {(stack_time_t)i * step, false, {MIDI_POLY_AFTERTOUCH}};
+		for (size_t column = 1; column <= 8; column++)
+		{
+			event.data.push_back(LaunchpadModelX::col_row_to_address(column, 5));
+			event.data.push_back((i * 7 + column * 13) % 128);
+		}
+		capture.events.push_back(event);
+	}
+	for (size_t column = 1; column <= 8; column++)
+	{
+		stack_launchpad_bench_add_event(&capture, 2049 * step, {MIDI_NOTE_OFF, LaunchpadModelX::col_row_to_address(column, 5), 0});
+	}
+
+	return capture;
+}
+
+// The device dropping out and coming back repeatedly (e.g. a bad cable), with
+// presses in between
+static BenchCapture stack_launchpad_bench_make_replug()
+{
+	BenchCapture capture = {"replug", {}, 0};
+	const stack_time_t step = 50 * NANOSECS_PER_MILLISEC;
+	for (size_t i = 0; i < 256; i++)
+	{
+		const unsigned char address = LaunchpadModelX::col_row_to_address(1 + i % 8, 2 + i % 8);
+		capture.events.push_back({(stack_time_t)i * step, true, {}});
+		stack_launchpad_bench_add_event(&capture, i * step + step / 4, {MIDI_NOTE_ON, address, 127});
+		stack_launchpad_bench_add_event(&capture, i * step + step / 2, {MIDI_NOTE_OFF, address, 0});
+	}
+
+	return capture;
+}
+
+// Loads a capture recorded by the plugin, using only the records of the given
+// device. The records are in order from the oldest, so we start after the
+// newest if the file has wrapped around. Returns false if it can't be read
+static bool stack_launchpad_bench_load_recording(FILE *file, const char *filename, uint8_t device_index, BenchCapture *capture)
+{
+	LaunchpadCaptureHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.version != LAUNCHPAD_CAPTURE_VERSION || header.record_size != sizeof(LaunchpadCaptureRecord) || header.capacity == 0)
+	{
+		fprintf(stderr, "%s: Not a capture that we can read\n", filename);
+		return false;
+	}
+
+	const uint64_t count = header.written < header.capacity ? header.written : header.capacity;
+	const uint64_t first = header.written < header.capacity ? 0 : header.written % header.capacity;
+	bool closed = false;
+	for (uint64_t i = 0; i < count; i++)
+	{
+		LaunchpadCaptureRecord record;
+		const off_t offset = sizeof(header) + ((first + i) % header.capacity) * sizeof(record);
+		if (fseeko(file, offset, SEEK_SET) != 0 || fread(&record, sizeof(record), 1, file) != 1 || record.length > LAUNCHPAD_CAPTURE_DATA_SIZE)
+		{
+			fprintf(stderr, "%s: Capture is truncated or corrupt\n", filename);
+			return false;
+		}
+		if (record.device != device_index)
+		{
+			continue;
+		}
+
+		switch (record.type)
+		{
+			case LAUNCHPAD_CAPTURE_IN:
+				// Long reads are split over records with the same time
+				if (capture->events.size() > 0 && !capture->events.back().replug && capture->events.back().time == record.time)
+				{
+					capture->events.back().data.insert(capture->events.back().data.end(), record.data, record.data + record.length);
+				}
+				else
+				{
+					capture->events.push_back({record.time, false, std::vector<unsigned char>(record.data, record.data + record.length)});
+				}
+				break;
+			case LAUNCHPAD_CAPTURE_OUT:
+				capture->bytes_written += record.length;
+				break;
+			case LAUNCHPAD_CAPTURE_CLOSED:
+				closed = true;
+				break;
+			case LAUNCHPAD_CAPTURE_OPENED:
+				// We replay the device coming back rather than going away,
+				// as that's where all the work is
+				if (closed)
+				{
+					capture->events.push_back({record.time, true, {}});
+					closed = false;
+				}
+				break;
+		}
+	}
+
+	// Replay from the first event rather than from when recording started
+	if (capture->events.size() > 0)
+	{
+		const stack_time_t start_time = capture->events.front().time;
+		for (auto &event : capture->events)
+		{
+			event.time -= start_time;
+		}
+	}
+
+	return true;
+}
+
+// Loads a capture from a file, which is either a text file or one recorded by
+// the plugin (in which case only the given device is used). Returns false if
+// it can't be read
+static bool stack_launchpad_bench_load_capture(const char *filename, uint8_t device_index, BenchCapture *capture)
+{
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open capture %s\n", filename);
+		return false;
+	}
+
+	capture->name = filename;
+	capture->bytes_written = 0;
+
+	char magic[sizeof(LAUNCHPAD_CAPTURE_MAGIC)];
+	if (fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, LAUNCHPAD_CAPTURE_MAGIC, sizeof(magic)) == 0)
+	{
+		rewind(file);
+		const bool result = stack_launchpad_bench_load_recording(file, filename, device_index, capture);
+		fclose(file);
+		return result;
+	}
+	rewind(file);
+
+	char line[4096];
+	size_t line_number = 0;
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		line_number++;
+		char *position = line;
+		while (*position == ' ' || *position == '\t')
+		{
+			position++;
+		}
+		if (*position == '#' || *position == '\n' || *position == '\0')
+		{
+			continue;
+		}
+
+		char *end = NULL;
+		const long long time_us = strtoll(position, &end, 10);
+		if (end == position)
+		{
+			fprintf(stderr, "%s:%zu: Expected a time\n", filename, line_number);
+			fclose(file);
+			return false;
+		}
+
+		BenchEvent event = {(stack_time_t)time_us * NANOSECS_PER_MICROSEC, false, {}};
+		position = end;
+		while (*position == ' ' || *position == '\t')
+		{
+			position++;
+		}
+		if (strncmp(position, "replug", 6) == 0)
+		{
+			event.replug = true;
+		}
+		else
+		{
+			while (true)
+			{
+				const unsigned long byte = strtoul(position, &end, 16);
+				if (end == position)
+				{
+					break;
+				}
+				event.data.push_back(byte & 0xff);
+				position = end;
+			}
+		}
+		capture->events.push_back(event);
+	}
+	fclose(file);
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SHOWS
+
+// Creates a trigger with the same defaults as stack_launchpad_trigger_create,
+// without adding it to anything
+static StackLaunchpadTrigger *stack_launchpad_bench_new_trigger()
+{
+	StackLaunchpadTrigger *trigger = new StackLaunchpadTrigger();
+	trigger->description = strdup("");
+	trigger->device_id = strdup("");
+	trigger->page = 1;
+	trigger->on_pressed = true;
+	trigger->pressure_curve = LAUNCHPAD_PRESSURE_CURVE_NONE;
+	trigger->debounce_ms = LAUNCHPAD_DEFAULT_DEBOUNCE_MS;
+	trigger->velocity_min = LAUNCHPAD_VELOCITY_MIN;
+	trigger->velocity_max = LAUNCHPAD_VELOCITY_MAX;
+	trigger->repeat_mode = LAUNCHPAD_REPEAT_IGNORE;
+	trigger->feedback_state = LAUNCHPAD_FEEDBACK_IDLE;
+	return trigger;
+}
+
+// Finds the JSON of every Launchpad trigger within a show. We don't need to
+// know the layout of the show, as the JSON of our triggers is always an object
+// with a StackLaunchpadTrigger member
+static void stack_launchpad_bench_find_triggers(const Json::Value &value, std::vector<Json::Value> *triggers)
+{
+	if (value.isObject())
+	{
+		if (value.isMember("StackLaunchpadTrigger") && value["StackLaunchpadTrigger"].isObject())
+		{
+			triggers->push_back(value);
+			return;
+		}
+		for (auto &member : value)
+		{
+			stack_launchpad_bench_find_triggers(member, triggers);
+		}
+	}
+	else if (value.isArray())
+	{
+		for (auto &element : value)
+		{
+			stack_launchpad_bench_find_triggers(element, triggers);
+		}
+	}
+}
+
+// Loads all the Launchpad triggers from a show file on to the device, in the
+// same way that Stack would. Returns the number of triggers, or -1 if the
+// show can't be read
+static ssize_t stack_launchpad_bench_load_show(const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open show %s\n", filename);
+		return -1;
+	}
+	std::string contents;
+	char buffer[65536];
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		contents.append(buffer, length);
+	}
+	fclose(file);
+
+	Json::Value show_root;
+	if (!stack_json_read_string(contents.c_str(), &show_root))
+	{
+		fprintf(stderr, "%s: Not a valid show file\n", filename);
+		return -1;
+	}
+
+	std::vector<Json::Value> triggers;
+	stack_launchpad_bench_find_triggers(show_root, &triggers);
+
+	// Stack hands each trigger its own JSON, so we do the same
+	Json::StreamWriterBuilder builder;
+	std::vector<std::string> trigger_json;
+	for (auto &trigger_root : triggers)
+	{
+		// Everything goes on our device
+		trigger_root["StackLaunchpadTrigger"].removeMember("device");
+		trigger_json.push_back(Json::writeString(builder, trigger_root));
+	}
+
+	// Triggers are staged as they're created, and then added all at once when
+	// the main loop would next be idle
+	const stack_time_t start_time = stack_get_clock_time();
+	for (auto &json : trigger_json)
+	{
+		StackLaunchpadTrigger *trigger = stack_launchpad_bench_new_trigger();
+		list_mutex.lock();
+		trigger->staged = true;
+		trigger_list.push_back(trigger);
+		trigger_count = trigger_list.size();
+		list_mutex.unlock();
+		stack_launchpad_trigger_from_json(STACK_TRIGGER(trigger), json.c_str());
+	}
+	stack_launchpad_trigger_finish_load(NULL);
+	const stack_time_t load_time = stack_get_clock_time() - start_time;
+	printf("%s: %zu triggers loaded in %.1f ms\n", filename, triggers.size(), (double)load_time / NANOSECS_PER_MILLISEC);
+
+	// Saving the show does the opposite
+	const stack_time_t save_start_time = stack_get_clock_time();
+	list_mutex.lock();
+	std::vector<StackLaunchpadTrigger*> save_triggers(trigger_list.begin(), trigger_list.end());
+	list_mutex.unlock();
+	size_t save_bytes = 0;
+	for (auto trigger : save_triggers)
+	{
+		char *json_data = stack_launchpad_trigger_to_json(STACK_TRIGGER(trigger));
+		save_bytes += strlen(json_data);
+		stack_launchpad_trigger_free_json(STACK_TRIGGER(trigger), json_data);
+	}
+	const stack_time_t save_time = stack_get_clock_time() - save_start_time;
+	printf("%s: %zu triggers saved in %.1f ms (%zu bytes)\n", filename, save_triggers.size(), (double)save_time / NANOSECS_PER_MILLISEC, save_bytes);
+
+	return triggers.size();
+}
+
+// Creates a show of the given number of triggers on the device, spread over
+// as many pages as it takes, with several triggers on each button for large
+// shows. This does what loading a show would, but without the JSON
+static void stack_launchpad_bench_create_show(LaunchpadDevice *device, size_t count)
+{
+	list_mutex.lock();
+	for (size_t i = 0; i < count; i++)
+	{
+		StackLaunchpadTrigger *trigger = stack_launchpad_bench_new_trigger();
+		trigger->column = 1 + i % 8;
+		trigger->row = 2 + (i / 8) % 8;
+		trigger->page = 1 + (i / 64) % LAUNCHPAD_MAX_PAGES;
+		trigger->r = (i * 37) % 256;
+		trigger->g = (i * 91) % 256;
+		trigger->b = (i * 53) % 256;
+		trigger->pressure_curve = i % 2 == 0 ? LAUNCHPAD_PRESSURE_CURVE_LINEAR : LAUNCHPAD_PRESSURE_CURVE_NONE;
+		trigger->debounce_ms = 0;
+		trigger_list.push_back(trigger);
+	}
+	trigger_count = trigger_list.size();
+	stack_launchpad_trigger_update_buttons(device);
+	list_mutex.unlock();
+}
+
+static void stack_launchpad_bench_destroy_show(LaunchpadDevice *device)
+{
+	list_mutex.lock();
+	for (auto trigger : trigger_list)
+	{
+		free(trigger->description);
+		free(trigger->device_id);
+		delete trigger;
+	}
+	trigger_list.clear();
+	trigger_count = 0;
+	stack_launchpad_trigger_update_buttons(device);
+	list_mutex.unlock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// RUNNING
+
+// Does what the UI thread would with any queued actions, which is nothing as
+// we have no cues
+static void stack_launchpad_bench_consume_actions()
+{
+	action_queue.tail.store(action_queue.head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+// Does what the LED thread would, returning the number of bytes sent
+static uint64_t stack_launchpad_bench_flush(LaunchpadDevice *device, BenchResult *result)
+{
+	led_mutex.lock();
+	const bool dirty = led_dirty_devices.size() > 0;
+	led_dirty_devices.clear();
+	led_mutex.unlock();
+	if (!dirty)
+	{
+		return 0;
+	}
+
+	const uint64_t bytes_before = bench_port.bytes_written;
+	stack_launchpad_trigger_midi_flush(device);
+	const uint64_t bytes = bench_port.bytes_written - bytes_before;
+	if (bytes > 0)
+	{
+		result->flushes++;
+		result->bytes_written += bytes;
+	}
+
+	return bytes;
+}
+
+// Counts the complete messages in some data
+static uint64_t stack_launchpad_bench_count_messages(const std::vector<unsigned char> &data)
+{
+	LaunchpadMidiParser parser;
+	stack_launchpad_trigger_parser_reset(&parser);
+	uint64_t messages = 0;
+	for (auto byte : data)
+	{
+		LaunchpadMidiMessage message;
+		if (stack_launchpad_trigger_parse_byte(&parser, byte, &message))
+		{
+			messages++;
+		}
+	}
+	return messages;
+}
+
+// Replays a capture against the device, timing how long each event takes to
+// be handled (including sending any LED changes that it makes). If realtime
+// is set, events are fed in with the timing of the capture, otherwise as
+// quickly as possible
+static BenchResult stack_launchpad_bench_replay(LaunchpadDevice *device, const BenchCapture *capture, bool realtime)
+{
+	BenchResult result = {{}, 0, 0, 0, 0};
+	result.latencies.reserve(capture->events.size());
+
+	const stack_time_t start_time = stack_get_clock_time();
+	for (auto &event : capture->events)
+	{
+		if (realtime)
+		{
+			const stack_time_t wait = start_time + event.time - stack_get_clock_time();
+			if (wait > 0)
+			{
+				std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+			}
+		}
+
+		const stack_time_t event_start = stack_get_clock_time();
+		if (event.replug)
+		{
+			stack_launchpad_trigger_close_device(device);
+			midi_backend->open(device, "bench");
+			stack_launchpad_trigger_device_opened(device);
+		}
+		else
+		{
+			result.messages += stack_launchpad_bench_count_messages(event.data);
+			clock_gettime(CLOCK_MONOTONIC, &bench_port.input_time);
+			bench_port.input.push_back(event);
+			while (bench_port.input.size() > 0)
+			{
+				stack_launchpad_trigger_read_device(device);
+			}
+		}
+
+		// Fire any timers and apply any pressure that's due, as the thread
+		// would after each poll
+		dispatch_generation++;
+		const LaunchpadDispatchTable *table = device->dispatch.load();
+		const stack_time_t now = stack_get_clock_time();
+		stack_launchpad_trigger_process_timers(device, table, now);
+		stack_launchpad_trigger_flush_pressure(device, table, now);
+		dispatch_generation++;
+
+		stack_launchpad_bench_flush(device, &result);
+		result.latencies.push_back(stack_get_clock_time() - event_start);
+		stack_launchpad_bench_consume_actions();
+	}
+	result.elapsed = stack_get_clock_time() - start_time;
+
+	return result;
+}
+
+// Times rebuilding and sending every LED of the show, as happens when a
+// device is opened or the global buttons change
+static BenchResult stack_launchpad_bench_updates(LaunchpadDevice *device)
+{
+	BenchResult result = {{}, 0, 0, 0, 0};
+	result.latencies.reserve(BENCH_UPDATE_REPEATS);
+
+	const stack_time_t start_time = stack_get_clock_time();
+	for (size_t i = 0; i < BENCH_UPDATE_REPEATS; i++)
+	{
+		const stack_time_t update_start = stack_get_clock_time();
+		list_mutex.lock();
+		stack_launchpad_trigger_midi_refresh_colors(device);
+		stack_launchpad_trigger_update_buttons(device);
+		list_mutex.unlock();
+		stack_launchpad_bench_flush(device, &result);
+		result.latencies.push_back(stack_get_clock_time() - update_start);
+		result.messages++;
+	}
+	result.elapsed = stack_get_clock_time() - start_time;
+
+	return result;
+}
+
+// Times recolouring the triggers on the given number of buttons of the first
+// page, as happens when a cue list changes scene. Only those buttons should get
+// sent to the device
+static BenchResult stack_launchpad_bench_scene(LaunchpadDevice *device, size_t buttons)
+{
+	BenchResult result = {{}, 0, 0, 0, 0};
+	result.latencies.reserve(BENCH_UPDATE_REPEATS);
+
+	const stack_time_t start_time = stack_get_clock_time();
+	for (size_t i = 0; i < BENCH_UPDATE_REPEATS; i++)
+	{
+		const stack_time_t update_start = stack_get_clock_time();
+		list_mutex.lock();
+		for (auto trigger : trigger_list)
+		{
+			const int index = stack_launchpad_trigger_button_index(trigger->column, trigger->row);
+			if (trigger->page == 1 && trigger->row >= 2 && index >= 0 && (size_t)((trigger->row - 2) * 8 + trigger->column - 1) < buttons)
+			{
+				trigger->r += 64;
+				trigger->g += 32;
+			}
+		}
+		stack_launchpad_trigger_update_buttons(device);
+		list_mutex.unlock();
+		stack_launchpad_bench_flush(device, &result);
+		result.latencies.push_back(stack_get_clock_time() - update_start);
+		result.messages++;
+	}
+	result.elapsed = stack_get_clock_time() - start_time;
+
+	return result;
+}
+
+// Makes a stream of everything a device might send: presses and releases
+// on both the grid and the edges (some with running status), aftertouch,
+// SysEx replies and clock bytes in between
+static std::vector<unsigned char> stack_launchpad_bench_make_parse_stream()
+{
+	static const unsigned char sysex_reply[] = {MIDI_SYSEX, 0x00, 0x20, 0x29, 0x02, 0x0c, 0x00, 0x7f, MIDI_SYSEX_END};
+	std::vector<unsigned char> stream;
+	for (size_t i = 0; i < 4096; i++)
+	{
+		const unsigned char note = (unsigned char)(11 + (i % 8) + 10 * ((i / 8) % 9));
+		switch (i % 8)
+		{
+			case 0:
+			case 4:
+				stream.insert(stream.end(), {MIDI_NOTE_ON, note, (unsigned char)(1 + i % 127), note, 0});
+				break;
+			case 1:
+				stream.insert(stream.end(), {MIDI_POLY_AFTERTOUCH, note, (unsigned char)(i % 128), note, (unsigned char)((i + 7) % 128), note, (unsigned char)((i + 14) % 128)});
+				break;
+			case 2:
+				stream.insert(stream.end(), {MIDI_CONTROL_CHANGE, (unsigned char)(91 + i % 8), 127, MIDI_CONTROL_CHANGE, (unsigned char)(91 + i % 8), 0});
+				break;
+			case 3:
+				stream.insert(stream.end(), {MIDI_NOTE_ON, note, 100, 0xf8, MIDI_NOTE_OFF, note, 0});
+				break;
+			case 5:
+				stream.insert(stream.end(), std::begin(sysex_reply), std::end(sysex_reply));
+				break;
+			default:
+				stream.insert(stream.end(), {MIDI_NOTE_ON, note, 64, 0xf8, note, 0});
+				break;
+		}
+	}
+	return stream;
+}
+
+// Times only parsing a stream and finding the page and button of each press
+// against the dispatch table, in reads of the size the MIDI thread uses. This
+// leaves out everything that a press then does, so is the cost that every
+// byte from the device has. The latencies are per read
+static BenchResult stack_launchpad_bench_parse(LaunchpadDevice *device, const std::vector<unsigned char> &stream)
+{
+	BenchResult result = {{}, 0, 0, 0, 0};
+	result.latencies.reserve(BENCH_PARSE_REPEATS * (stream.size() / LAUNCHPAD_READ_BUFFER_SIZE + 1));
+
+	// Stops the compiler optimising the lookups away
+	volatile int sink = 0;
+
+	dispatch_generation++;
+	const LaunchpadDispatchTable *table = device->dispatch.load();
+	LaunchpadMidiParser parser;
+	stack_launchpad_trigger_parser_reset(&parser);
+	const stack_time_t start_time = stack_get_clock_time();
+	for (size_t i = 0; i < BENCH_PARSE_REPEATS; i++)
+	{
+		for (size_t offset = 0; offset < stream.size(); offset += LAUNCHPAD_READ_BUFFER_SIZE)
+		{
+			const stack_time_t read_start = stack_get_clock_time();
+			const size_t end = std::min(offset + LAUNCHPAD_READ_BUFFER_SIZE, stream.size());
+			for (size_t j = offset; j < end; j++)
+			{
+				LaunchpadMidiMessage message;
+				if (!stack_launchpad_trigger_parse_byte(&parser, stream[j], &message))
+				{
+					continue;
+				}
+				result.messages++;
+
+				LaunchpadButtonTarget target;
+				switch (message.status)
+				{
+					case MIDI_NOTE_ON:
+					case MIDI_NOTE_OFF:
+					case MIDI_CONTROL_CHANGE:
+					case MIDI_POLY_AFTERTOUCH:
+						if (stack_launchpad_trigger_resolve_button(device->profile, table, device->page.load(), message.data[0], &target))
+						{
+							sink = sink + target.index + (int)target.page->button_triggers[target.index].size();
+						}
+						break;
+				}
+			}
+			result.latencies.push_back(stack_get_clock_time() - read_start);
+		}
+	}
+	result.elapsed = stack_get_clock_time() - start_time;
+	dispatch_generation++;
+
+	return result;
+}
+
+// Returns a percentile (0-1) of some sorted latencies, in microseconds
+static double stack_launchpad_bench_percentile(const std::vector<stack_time_t> &sorted, double percentile)
+{
+	if (sorted.size() == 0)
+	{
+		return 0.0;
+	}
+
+	size_t index = (size_t)ceil(percentile * sorted.size());
+	index = index > 0 ? index - 1 : 0;
+	return (double)sorted[std::min(index, sorted.size() - 1)] / NANOSECS_PER_MICROSEC;
+}
+
+static void stack_launchpad_bench_print_header()
+{
+	printf("%-12s %8s %9s %12s %9s %9s %9s %9s %8s %10s\n", "Run", "Triggers", "Events", "Events/s", "p50 us", "p90 us", "p99 us", "Max us", "Flushes", "Bytes/flush");
+}
+
+static void stack_launchpad_bench_print_result(const char *name, size_t triggers, BenchResult *result)
+{
+	std::sort(result->latencies.begin(), result->latencies.end());
+	const double seconds = (double)result->elapsed / NANOSECS_PER_SEC;
+	printf("%-12s %8zu %9llu %12.0f %9.1f %9.1f %9.1f %9.1f %8llu %10.1f\n", name, triggers,
+		(unsigned long long)result->messages, seconds > 0.0 ? result->messages / seconds : 0.0,
+		stack_launchpad_bench_percentile(result->latencies, 0.5),
+		stack_launchpad_bench_percentile(result->latencies, 0.9),
+		stack_launchpad_bench_percentile(result->latencies, 0.99),
+		stack_launchpad_bench_percentile(result->latencies, 1.0),
+		(unsigned long long)result->flushes,
+		result->flushes > 0 ? (double)result->bytes_written / result->flushes : 0.0);
+}
+
+static void stack_launchpad_bench_usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--triggers N[,N...]] [--show FILE] [--capture FILE [--device N]] [--realtime] [--verbose]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<size_t> trigger_counts(std::begin(bench_default_trigger_counts), std::end(bench_default_trigger_counts));
+	std::vector<const char*> capture_filenames;
+	std::vector<BenchCapture> captures;
+	const char *show_filename = NULL;
+	uint8_t device_index = 0;
+	bool realtime = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--triggers") == 0 && i + 1 < argc)
+		{
+			trigger_counts.clear();
+			for (char *count = strtok(argv[++i], ","); count != NULL; count = strtok(NULL, ","))
+			{
+				trigger_counts.push_back(strtoul(count, NULL, 10));
+			}
+		}
+		else if (strcmp(argv[i], "--show") == 0 && i + 1 < argc)
+		{
+			show_filename = argv[++i];
+		}
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+		{
+			capture_filenames.push_back(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+		{
+			device_index = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--realtime") == 0)
+		{
+			realtime = true;
+		}
+		else if (strcmp(argv[i], "--verbose") == 0)
+		{
+			bench_verbose = true;
+		}
+		else
+		{
+			stack_launchpad_bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	// Load the captures, or without any, use our own
+	for (auto filename : capture_filenames)
+	{
+		BenchCapture capture;
+		if (!stack_launchpad_bench_load_capture(filename, device_index, &capture))
+		{
+			return 1;
+		}
+		if (capture.bytes_written > 0)
+		{
+			printf("%s: %zu events, %llu bytes were written to the device when recorded\n", filename, capture.events.size(), (unsigned long long)capture.bytes_written);
+		}
+		captures.push_back(capture);
+	}
+	if (captures.size() == 0)
+	{
+		captures.push_back(stack_launchpad_bench_make_roll());
+		captures.push_back(stack_launchpad_bench_make_aftertouch());
+		captures.push_back(stack_launchpad_bench_make_replug());
+	}
+	const std::vector<unsigned char> parse_stream = stack_launchpad_bench_make_parse_stream();
+
+	// Set up the device with our loopback in place of ALSA
+	midi_backend = &launchpad_bench_backend;
+	action_queue.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	device_mutex.lock();
+	LaunchpadDevice *device = stack_launchpad_trigger_new_device("bench", stack_launchpad_trigger_find_profile(LaunchpadModelX::NAME, ""));
+	device_mutex.unlock();
+	midi_backend->open(device, "bench");
+	stack_launchpad_trigger_device_opened(device);
+
+	// Use the show we were given, if any, in place of our own
+	if (show_filename != NULL)
+	{
+		const ssize_t count = stack_launchpad_bench_load_show(show_filename);
+		if (count < 0)
+		{
+			return 1;
+		}
+		trigger_counts.assign(1, count);
+	}
+
+	stack_launchpad_bench_print_header();
+	for (auto count : trigger_counts)
+	{
+		if (show_filename == NULL)
+		{
+			stack_launchpad_bench_create_show(device, count);
+		}
+
+		BenchResult result = stack_launchpad_bench_updates(device);
+		stack_launchpad_bench_print_result("update", count, &result);
+
+		for (auto buttons : bench_scene_sizes)
+		{
+			result = stack_launchpad_bench_scene(device, buttons);
+			char name[32];
+			snprintf(name, sizeof(name), "scene-%zu", buttons);
+			stack_launchpad_bench_print_result(name, count, &result);
+		}
+
+		for (auto &capture : captures)
+		{
+			result = stack_launchpad_bench_replay(device, &capture, realtime);
+			stack_launchpad_bench_print_result(capture.name.c_str(), count, &result);
+		}
+
+		result = stack_launchpad_bench_parse(device, parse_stream);
+		stack_launchpad_bench_print_result("parse", count, &result);
+
+		stack_launchpad_bench_destroy_show(device);
+	}
+
+	// Show where the time went within the plugin
+	char report[LAUNCHPAD_LATENCY_REPORT_SIZE];
+	stack_launchpad_trigger_latency_report(report, sizeof(report));
+	printf("\nStages (all runs):\n%s", report);
+
+	return 0;
+}
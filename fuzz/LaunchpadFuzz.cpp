@@ -0,0 +1,260 @@
+// Fuzz target for the MIDI input path of the Launchpad trigger: the streaming
+// parser, finding what each button does in a dispatch table, and lighting and
+// encoding the LEDs that presses change. It only uses launchpad-core, so needs
+// neither GTK, Stack nor a device.
+//
+// Each input is treated as bytes read from a device. The first byte picks the
+// model and the page shown, and the second how the rest is split in to reads
+// (as partial reads leave the parser part way through a message). The rest is
+// parsed both in one go and split, which must give the same messages. Every
+// message is then handled as the MIDI thread would, against a synthetic
+// dispatch table with several pages and cue list controls enabled. Anything
+// inconsistent aborts, and building with AddressSanitizer (as the CMake target
+// does with clang) catches any access out of bounds.
+//
+// Built with clang this is a libFuzzer target:
+//
+//     ./launchpad-fuzzer corpus/
+//
+// Built with LAUNCHPAD_FUZZ_STANDALONE (which is the default for other
+// compilers) it runs each file given on the command line once, or standard
+// input if there are none, which is what AFL expects:
+//
+//     afl-fuzz -i corpus -o findings -- ./launchpad-fuzzer
+
+// Includes:
+#include "../src/LaunchpadCore.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Definitions: The number of pages in the dispatch table
+#define FUZZ_PAGES 3
+
+// Definitions: How many messages are handled between encoding the changed LEDs
+#define FUZZ_ENCODE_INTERVAL 8
+
+// Definitions: Aborts (so that the fuzzer keeps the input) if a condition
+// doesn't hold
+#define FUZZ_CHECK(condition) do { if (!(condition)) { fprintf(stderr, "Check failed: %s\n", #condition); abort(); } } while (0)
+
+// The models an input can pick between, by a name that matches each profile
+static const char *fuzz_models[] = {"Launchpad X", "Mini MK3", "Pro MK3", "MK2"};
+
+// Stand-ins for the triggers. The table only points at them, and they're
+// never looked at
+static char fuzz_triggers[LAUNCHPAD_MAX_BUTTONS];
+
+// Builds our dispatch table: triggers on a third of the buttons of every page
+// (a different third each page), cue list controls enabled so that the global
+// buttons are active, and the default global buttons
+static LaunchpadDispatchTable *stack_launchpad_fuzz_make_table()
+{
+	static const LaunchpadGlobalButton global_buttons[GLOBAL_BUTTON_COUNT] = {
+		{1, 1, 255, 255, 255}, {2, 1, 255, 255, 255}, {3, 1, 255, 255, 255},
+		{4, 1, 255, 255, 255}, {9, 9, 0, 255, 0}, {9, 6, 255, 0, 0},
+	};
+
+	LaunchpadDispatchTable *table = new LaunchpadDispatchTable();
+	table->pages.resize(FUZZ_PAGES);
+	for (size_t page = 0; page < FUZZ_PAGES; page++)
+	{
+		for (size_t i = 0; i < LAUNCHPAD_MAX_BUTTONS; i++)
+		{
+			if ((i + page) % 3 == 0)
+			{
+				table->pages[page].button_triggers[i].push_back(reinterpret_cast<StackLaunchpadTrigger*>(&fuzz_triggers[i]));
+			}
+			table->pages[page].button_policies[i] = {0, false, false};
+		}
+	}
+	table->cue_list_triggers.push_back(reinterpret_cast<StackLaunchpadTrigger*>(&fuzz_triggers[0]));
+	memcpy(table->global_buttons, global_buttons, sizeof(global_buttons));
+	stack_launchpad_trigger_place_page_buttons(table);
+
+	return table;
+}
+
+// Parses data in reads of at most read_size bytes, keeping the parser between
+// reads as the MIDI thread does, and returns the complete messages
+static std::vector<LaunchpadMidiMessage> stack_launchpad_fuzz_parse(const uint8_t *data, size_t size, size_t read_size)
+{
+	std::vector<LaunchpadMidiMessage> messages;
+	LaunchpadMidiParser parser;
+	stack_launchpad_trigger_parser_reset(&parser);
+	for (size_t offset = 0; offset < size; offset += read_size)
+	{
+		const size_t length = size - offset < read_size ? size - offset : read_size;
+		for (size_t i = 0; i < length; i++)
+		{
+			LaunchpadMidiMessage message;
+			if (stack_launchpad_trigger_parse_byte(&parser, data[offset + i], &message))
+			{
+				// Only channel messages are passed on, and never with status
+				// bytes in their data
+				FUZZ_CHECK(message.status >= MIDI_NOTE_OFF && message.status < MIDI_SYSEX);
+				FUZZ_CHECK(message.data[0] < 0x80 && message.data[1] < 0x80);
+				messages.push_back(message);
+			}
+			FUZZ_CHECK(parser.data_count <= sizeof(parser.data) && parser.data_needed <= sizeof(parser.data));
+		}
+	}
+
+	return messages;
+}
+
+// Encodes the changed LEDs, checking that the messages fit and that nothing
+// is left to send
+static void stack_launchpad_fuzz_encode(const LaunchpadProfile *profile, LaunchpadLeds *leds)
+{
+	LaunchpadLedOutput output;
+	const size_t changed_count = profile->encode_leds(leds, &output);
+	FUZZ_CHECK(changed_count <= LAUNCHPAD_MAX_BUTTONS);
+	FUZZ_CHECK(output.short_length <= LAUNCHPAD_MAX_SHORT_SIZE && output.sysex_length <= LAUNCHPAD_MAX_SYSEX_SIZE);
+	FUZZ_CHECK(output.sysex_length == 0 || (output.sysex_data[0] == MIDI_SYSEX && output.sysex_data[output.sysex_length - 1] == MIDI_SYSEX_END));
+	FUZZ_CHECK(output.short_messages * 3 == output.short_length);
+	for (size_t i = 0; i < LAUNCHPAD_MAX_BUTTONS; i++)
+	{
+		FUZZ_CHECK(!leds->dirty[i]);
+	}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static LaunchpadDispatchTable *table = stack_launchpad_fuzz_make_table();
+	if (size < 2)
+	{
+		return 0;
+	}
+
+	// Pick the model, page and read size. The shown page can be beyond the
+	// pages of the table, as happens when a table is rebuilt with fewer pages
+	const LaunchpadProfile *profile = stack_launchpad_trigger_find_profile(fuzz_models[data[0] % (sizeof(fuzz_models) / sizeof(fuzz_models[0]))], "");
+	size_t shown_page = (data[0] >> 2) % (FUZZ_PAGES + 2);
+	const size_t read_size = 1 + data[1] % 64;
+	data += 2;
+	size -= 2;
+
+	// Splitting the input across reads must not change what is parsed
+	const std::vector<LaunchpadMidiMessage> messages = stack_launchpad_fuzz_parse(data, size, size);
+	const std::vector<LaunchpadMidiMessage> split_messages = stack_launchpad_fuzz_parse(data, size, read_size);
+	FUZZ_CHECK(messages.size() == split_messages.size());
+	FUZZ_CHECK(messages.size() == 0 || memcmp(messages.data(), split_messages.data(), messages.size() * sizeof(LaunchpadMidiMessage)) == 0);
+
+	LaunchpadLeds leds;
+	memset(&leds, 0, sizeof(leds));
+	for (size_t i = 0; i < LAUNCHPAD_MAX_BUTTONS; i++)
+	{
+		leds.sent[i].mode = LAUNCHPAD_LED_UNKNOWN;
+	}
+
+	size_t handled = 0;
+	for (auto &message : messages)
+	{
+		uint8_t pressure = message.data[1];
+		switch (message.status)
+		{
+			case MIDI_NOTE_OFF:
+				pressure = 0;
+				// Fall through
+			case MIDI_NOTE_ON:
+			case MIDI_CONTROL_CHANGE:
+			case MIDI_POLY_AFTERTOUCH:
+				break;
+			default:
+				continue;
+		}
+
+		LaunchpadButtonTarget target;
+		if (!stack_launchpad_trigger_resolve_button(profile, table, shown_page, message.data[0], &target))
+		{
+			continue;
+		}
+		FUZZ_CHECK(target.column >= 1 && target.column <= profile->columns && target.row >= 1 && target.row <= profile->rows);
+		FUZZ_CHECK(target.index >= 0 && target.index < LAUNCHPAD_MAX_BUTTONS);
+		FUZZ_CHECK(target.page >= &table->pages.front() && target.page <= &table->pages.back());
+		FUZZ_CHECK(target.page_button < (int)table->pages.size());
+		FUZZ_CHECK(target.page_button < 0 || target.global_button == NULL);
+
+		if (target.page_button >= 0)
+		{
+			if (pressure > 0)
+			{
+				shown_page = target.page_button;
+			}
+			continue;
+		}
+
+		// Light the button with a colour made from the press, flashing or
+		// pulsing it if it has triggers, as playback feedback would
+		const LaunchpadTriggerVector &triggers = target.page->button_triggers[target.index];
+		const uint8_t mode = triggers.size() > 0 ? (pressure % 3) : LAUNCHPAD_LED_STATIC;
+		if (stack_launchpad_trigger_light_led(&leds, target.index, mode, pressure * 2, message.data[0] * 2, pressure ^ message.data[0]))
+		{
+			leds.dirty[target.index] = true;
+		}
+
+		if (++handled % FUZZ_ENCODE_INTERVAL == 0)
+		{
+			stack_launchpad_fuzz_encode(profile, &leds);
+		}
+	}
+	stack_launchpad_fuzz_encode(profile, &leds);
+
+	// Putting the device in to programmer mode doesn't depend on the input,
+	// but does depend on the model
+	unsigned char programmer_mode[LAUNCHPAD_MAX_PROGRAMMER_MODE_SIZE];
+	const size_t programmer_mode_length = profile->encode_programmer_mode(programmer_mode);
+	FUZZ_CHECK(programmer_mode_length <= sizeof(programmer_mode) && programmer_mode[programmer_mode_length - 1] == MIDI_SYSEX_END);
+
+	return 0;
+}
+
+#ifdef LAUNCHPAD_FUZZ_STANDALONE
+// Reads the whole of a file, returning false if it can't be read
+static bool stack_launchpad_fuzz_read_file(FILE *file, std::vector<uint8_t> *data)
+{
+	uint8_t buffer[4096];
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		data->insert(data->end(), buffer, buffer + length);
+	}
+
+	return !ferror(file);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		std::vector<uint8_t> data;
+		if (!stack_launchpad_fuzz_read_file(stdin, &data))
+		{
+			fprintf(stderr, "Failed to read standard input\n");
+			return 1;
+		}
+		return LLVMFuzzerTestOneInput(data.data(), data.size());
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		FILE *file = fopen(argv[i], "rb");
+		std::vector<uint8_t> data;
+		if (file == NULL || !stack_launchpad_fuzz_read_file(file, &data))
+		{
+			fprintf(stderr, "%s: Failed to read\n", argv[i]);
+			if (file != NULL)
+			{
+				fclose(file);
+			}
+			return 1;
+		}
+		fclose(file);
+		LLVMFuzzerTestOneInput(data.data(), data.size());
+	}
+
+	return 0;
+}
+#endif
@@ -0,0 +1,579 @@
+// Includes:
+#include "LaunchpadCore.h"
+#include <cstring>
+
+////////////////////////////////////////////////////////////////////////////////
+// TRIGGER INDEX
+
+// Returns whether any page of a dispatch table has triggers on a button
+static bool stack_launchpad_trigger_button_has_triggers(const LaunchpadDispatchTable *table, uint8_t index)
+{
+	for (auto &page : table->pages)
+	{
+		if (page.button_triggers[index].size() > 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Chooses which buttons select the pages of a dispatch table, skipping those
+// of the global buttons so that both always work, and those of triggers if
+// there are enough other buttons
+void stack_launchpad_trigger_place_page_buttons(LaunchpadDispatchTable *table)
+{
+	table->page_button_count = 0;
+	memset(table->button_pages, 0, sizeof(table->button_pages));
+	const size_t page_count = table->pages.size() <= LAUNCHPAD_MAX_PAGES ? table->pages.size() : LAUNCHPAD_MAX_PAGES;
+	if (page_count < 2)
+	{
+		return;
+	}
+
+	// The buttons that page buttons can go on: the top row (except the logo
+	// in the top-right) then down the right-hand column
+	uint8_t free_buttons[LAUNCHPAD_MAX_COLUMNS - 1 + LAUNCHPAD_MAX_ROWS - 1];
+	size_t top_count = 0, free_count = 0;
+	for (uint8_t column = 1; column < LAUNCHPAD_MAX_COLUMNS; column++)
+	{
+		if (stack_launchpad_trigger_get_global_button(table, column, 1) == NULL)
+		{
+			free_buttons[free_count++] = stack_launchpad_trigger_button_index(column, 1);
+			top_count++;
+		}
+	}
+	for (uint8_t row = 2; row <= LAUNCHPAD_MAX_ROWS; row++)
+	{
+		if (stack_launchpad_trigger_get_global_button(table, LAUNCHPAD_MAX_COLUMNS, row) == NULL)
+		{
+			free_buttons[free_count++] = stack_launchpad_trigger_button_index(LAUNCHPAD_MAX_COLUMNS, row);
+		}
+	}
+
+	// Of those, the ones that no trigger is on
+	uint8_t unused_buttons[sizeof(free_buttons)];
+	size_t unused_top_count = 0, unused_count = 0;
+	for (size_t i = 0; i < free_count; i++)
+	{
+		if (!stack_launchpad_trigger_button_has_triggers(table, free_buttons[i]))
+		{
+			unused_top_count += i < top_count;
+			unused_buttons[unused_count++] = free_buttons[i];
+		}
+	}
+
+	// Only cover triggers if there's no other way to have every page
+	const uint8_t *buttons = free_buttons;
+	if (unused_count >= page_count)
+	{
+		buttons = unused_buttons;
+		free_count = unused_count;
+		top_count = unused_top_count;
+	}
+
+	// Keep the page buttons at the right of the top row if they fit, and
+	// otherwise use all of it before the column. With at most six global
+	// buttons there is always room for every page
+	const size_t first = page_count <= top_count ? top_count - page_count : 0;
+	for (size_t i = first; i < free_count && table->page_button_count < page_count; i++)
+	{
+		table->button_pages[buttons[i]] = table->page_button_count + 1;
+		table->page_buttons[table->page_button_count++] = buttons[i];
+	}
+}
+
+// Returns the page (0-based) selected by the button at the given column/row
+// within a dispatch table, or -1 if it isn't a page button
+int stack_launchpad_trigger_get_page_button(const LaunchpadDispatchTable *table, uint8_t column, uint8_t row)
+{
+	const int index = stack_launchpad_trigger_button_index(column, row);
+	return index >= 0 ? (int)table->button_pages[index] - 1 : -1;
+}
+
+// Returns the global button at the given column/row within a dispatch table,
+// or NULL if there isn't one
+const LaunchpadGlobalButton *stack_launchpad_trigger_get_global_button(const LaunchpadDispatchTable *table, uint8_t column, uint8_t row)
+{
+	for (size_t i = 0; i < GLOBAL_BUTTON_COUNT; i++)
+	{
+		if (row == table->global_buttons[i].row && column == table->global_buttons[i].column)
+		{
+			return &table->global_buttons[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Returns a page (0-based) of a dispatch table, or the first page if the table
+// doesn't have that many
+const LaunchpadPage *stack_launchpad_trigger_get_page(const LaunchpadDispatchTable *table, size_t page)
+{
+	return &table->pages[page < table->pages.size() ? page : 0];
+}
+
+// Finds what the button at an address of a device with the given profile
+// does, whilst the given page is shown
+bool stack_launchpad_trigger_resolve_button(const LaunchpadProfile *profile, const LaunchpadDispatchTable *table, size_t shown_page, uint8_t address, LaunchpadButtonTarget *target)
+{
+	// Models can map addresses to buttons they don't have (such as column
+	// zero), so check the button against the size of the device as well as
+	// the grid
+	uint8_t column = 0, row = 0;
+	if (!profile->address_to_col_row(address, &column, &row) || column > profile->columns || row > profile->rows)
+	{
+		return false;
+	}
+	const int index = stack_launchpad_trigger_button_index(column, row);
+	if (index < 0)
+	{
+		return false;
+	}
+
+	target->column = column;
+	target->row = row;
+	target->index = index;
+	target->page_button = stack_launchpad_trigger_get_page_button(table, column, row);
+	target->global_button = table->cue_list_triggers.size() > 0 ? stack_launchpad_trigger_get_global_button(table, column, row) : NULL;
+	target->page = stack_launchpad_trigger_get_page(table, shown_page);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MIDI PARSER
+
+// Resets the parser to its initial state, discarding any partial message
+void stack_launchpad_trigger_parser_reset(LaunchpadMidiParser *parser)
+{
+	memset(parser, 0, sizeof(LaunchpadMidiParser));
+}
+
+// Returns the number of data bytes that follow the given status byte
+static uint8_t stack_launchpad_trigger_parser_data_length(uint8_t status)
+{
+	switch (status & 0xf0)
+	{
+		case MIDI_PROGRAM_CHANGE:
+		case MIDI_CHANNEL_PRESSURE:
+			return 1;
+		case 0xf0:
+			// System common messages
+			switch (status)
+			{
+				case 0xf1: // MTC quarter frame
+				case 0xf3: // Song select
+					return 1;
+				case 0xf2: // Song position pointer
+					return 2;
+				default:
+					return 0;
+			}
+		default:
+			return 2;
+	}
+}
+
+// Feeds a single byte read from the device in to the parser. Returns true and
+// fills in message if the byte completes a channel message. SysEx messages,
+// system common messages and real-time messages are all consumed silently
+bool stack_launchpad_trigger_parse_byte(LaunchpadMidiParser *parser, uint8_t byte, LaunchpadMidiMessage *message)
+{
+	// Real-time messages can appear anywhere (even in the middle of another
+	// message) and don't affect the running status
+	if (byte >= MIDI_REALTIME)
+	{
+		return false;
+	}
+
+	// Status bytes
+	if (byte & 0x80)
+	{
+		if (parser->data_count > 0)
+		{
+			parser->incomplete_count++;
+		}
+		parser->data_count = 0;
+
+		// SysEx starts and ends cancel the running status
+		if (byte == MIDI_SYSEX || byte == MIDI_SYSEX_END)
+		{
+			parser->in_sysex = (byte == MIDI_SYSEX);
+			parser->status = 0;
+			return false;
+		}
+
+		// Any other status byte terminates a SysEx message
+		parser->in_sysex = false;
+		parser->status = byte;
+		parser->data_needed = stack_launchpad_trigger_parser_data_length(byte);
+
+		// System common messages without data (and which cancel the running
+		// status)
+		if (parser->data_needed == 0)
+		{
+			parser->status = 0;
+		}
+
+		return false;
+	}
+
+	// Data bytes: skip over the contents of SysEx messages (such as replies
+	// from the device), and any data we have no status for
+	if (parser->in_sysex || parser->status == 0)
+	{
+		return false;
+	}
+
+	parser->data[parser->data_count++] = byte;
+	if (parser->data_count < parser->data_needed)
+	{
+		return false;
+	}
+
+	// We have a complete message. Keep the status so that subsequent data
+	// bytes can use running status
+	parser->data_count = 0;
+	if (parser->status >= MIDI_SYSEX)
+	{
+		// System common messages cancel the running status and aren't passed
+		// on
+		parser->status = 0;
+		return false;
+	}
+
+	message->status = parser->status;
+	message->data[0] = parser->data[0];
+	message->data[1] = parser->data_needed > 1 ? parser->data[1] : 0;
+	return true;
+}
+
+// Returns whether a message is a button being pressed or released, and if so
+// gives its pressure (zero for a release)
+bool stack_launchpad_trigger_button_pressure(const LaunchpadMidiMessage *message, uint8_t *pressure)
+{
+	switch (message->status)
+	{
+		case MIDI_NOTE_ON:
+		case MIDI_CONTROL_CHANGE:
+			*pressure = message->data[1];
+			return true;
+		case MIDI_NOTE_OFF:
+			*pressure = 0;
+			return true;
+		default:
+			return false;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// LEDS
+
+// The first 64 colours of the Launchpad palette, which the flashing and
+// pulsing LED modes have to use
+static constexpr uint8_t launchpad_palette[64][3] = {
+	{  0,   0,   0}, { 30,  30,  30}, {127, 127, 127}, {255, 255, 255},
+	{255,  76,  76}, {255,   0,   0}, { 89,   0,   0}, { 25,   0,   0},
+	{255, 189, 108}, {255,  84,   0}, { 89,  29,   0}, { 39,  27,   0},
+	{255, 255,  76}, {255, 255,   0}, { 89,  89,   0}, { 25,  25,   0},
+	{136, 255,  76}, { 84, 255,   0}, { 29,  89,   0}, { 20,  43,   0},
+	{ 76, 255,  76}, {  0, 255,   0}, {  0,  89,   0}, {  0,  25,   0},
+	{ 76, 255,  94}, {  0, 255,  25}, {  0,  89,  13}, {  0,  25,   2},
+	{ 76, 255, 136}, {  0, 255,  85}, {  0,  89,  29}, {  0,  31,  18},
+	{ 76, 255, 183}, {  0, 255, 153}, {  0,  89,  53}, {  0,  25,  18},
+	{ 76, 195, 255}, {  0, 169, 255}, {  0,  65,  82}, {  0,  16,  25},
+	{ 76, 136, 255}, {  0,  85, 255}, {  0,  29,  89}, {  0,   8,  25},
+	{ 76,  76, 255}, {  0,   0, 255}, {  0,   0,  89}, {  0,   0,  25},
+	{135,  76, 255}, { 84,   0, 255}, { 25,   0, 100}, { 15,   0,  48},
+	{255,  76, 255}, {255,   0, 255}, { 89,   0,  89}, { 25,   0,  25},
+	{255,  76, 135}, {255,   0,  84}, { 89,   0,  29}, { 34,   0,  19},
+	{255,  21,   0}, {153,  53,   0}, {121,  81,   0}, { 67, 100,   0},
+};
+
+// Typedefs: The nearest palette colour to every colour, with each component
+// reduced to LAUNCHPAD_PALETTE_LUT_BITS bits
+typedef struct LaunchpadPaletteLut
+{
+	uint8_t index[1 << (3 * LAUNCHPAD_PALETTE_LUT_BITS)];
+} LaunchpadPaletteLut;
+
+// Builds the palette lookup table. Each entry is the palette colour nearest to
+// the reduced colour scaled back up to 0-255, so that full and zero components
+// (which most of the palette is built from) land exactly
+static constexpr LaunchpadPaletteLut stack_launchpad_trigger_make_palette_lut()
+{
+	LaunchpadPaletteLut lut = {};
+	constexpr int levels = 1 << LAUNCHPAD_PALETTE_LUT_BITS;
+	for (int i = 0; i < levels * levels * levels; i++)
+	{
+		const int r = (i / (levels * levels)) * 255 / (levels - 1);
+		const int g = ((i / levels) % levels) * 255 / (levels - 1);
+		const int b = (i % levels) * 255 / (levels - 1);
+		int best_distance = -1;
+		for (int j = 0; j < 64; j++)
+		{
+			const int dr = launchpad_palette[j][0] - r;
+			const int dg = launchpad_palette[j][1] - g;
+			const int db = launchpad_palette[j][2] - b;
+			const int distance = dr * dr + dg * dg + db * db;
+			if (best_distance < 0 || distance < best_distance)
+			{
+				lut.index[i] = j;
+				best_distance = distance;
+			}
+		}
+	}
+	return lut;
+}
+
+static constexpr LaunchpadPaletteLut launchpad_palette_lut = stack_launchpad_trigger_make_palette_lut();
+
+// Returns the index of the colour in the Launchpad palette that is closest to
+// the given colour
+uint8_t stack_launchpad_trigger_palette_index(uint8_t r, uint8_t g, uint8_t b)
+{
+	constexpr int shift = 8 - LAUNCHPAD_PALETTE_LUT_BITS;
+	return launchpad_palette_lut.index[((r >> shift) << (2 * LAUNCHPAD_PALETTE_LUT_BITS)) | ((g >> shift) << LAUNCHPAD_PALETTE_LUT_BITS) | (b >> shift)];
+}
+
+// Changes how an LED is lit, along with its nearest palette colour. Returns
+// false if the LED was already lit that way
+bool stack_launchpad_trigger_light_led(LaunchpadLeds *leds, int index, uint8_t mode, uint8_t r, uint8_t g, uint8_t b)
+{
+	if (leds->mode[index] == mode && leds->r[index] == r && leds->g[index] == g && leds->b[index] == b)
+	{
+		return false;
+	}
+
+	const uint8_t palette = stack_launchpad_trigger_palette_index(r, g, b);
+	leds->mode[index] = mode;
+	leds->r[index] = r;
+	leds->g[index] = g;
+	leds->b[index] = b;
+	leds->palette[index] = palette;
+	leds->palette_exact[index] = launchpad_palette[palette][0] == r && launchpad_palette[palette][1] == g && launchpad_palette[palette][2] == b;
+	return true;
+}
+
+// Writes the SysEx header and the given command bytes for a model, returning
+// the number of bytes written
+template <typename Model> static size_t stack_launchpad_trigger_write_header(unsigned char *output, const unsigned char *command, size_t command_length)
+{
+	memcpy(output, Model::HEADER, sizeof(Model::HEADER));
+	memcpy(&output[sizeof(Model::HEADER)], command, command_length);
+	return sizeof(Model::HEADER) + command_length;
+}
+
+// Writes the note/CC messages that light an LED with its palette colour,
+// returning the number of bytes written
+template <typename Model> static size_t stack_launchpad_trigger_write_short_led(unsigned char *output, const LaunchpadLeds *leds, int index)
+{
+	const unsigned char address = LaunchpadLedMessage<Model>::ADDRESSES.address[index];
+	const unsigned char status = LaunchpadLedMessage<Model>::ADDRESSES.control[index] ? MIDI_CONTROL_CHANGE : MIDI_NOTE_ON;
+	switch (leds->mode[index])
+	{
+		case LAUNCHPAD_LED_FLASH:
+			// Flashing alternates with the static colour, so turn that off
+			output[0] = status | LAUNCHPAD_LED_CHANNEL_STATIC;
+			output[1] = address;
+			output[2] = 0;
+			output[3] = status | LAUNCHPAD_LED_CHANNEL_FLASH;
+			output[4] = address;
+			output[5] = leds->palette[index];
+			return 6;
+		case LAUNCHPAD_LED_PULSE:
+			output[0] = status | LAUNCHPAD_LED_CHANNEL_PULSE;
+			output[1] = address;
+			output[2] = leds->palette[index];
+			return 3;
+		default:
+			output[0] = status | LAUNCHPAD_LED_CHANNEL_STATIC;
+			output[1] = address;
+			output[2] = leds->palette[index];
+			return 3;
+	}
+}
+
+// Writes the SysEx entry that lights an LED with its palette colour, for
+// models with typed entries, returning the number of bytes written
+template <typename Model> static size_t stack_launchpad_trigger_write_sysex_palette_led(unsigned char *output, const LaunchpadLeds *leds, int index)
+{
+	output[1] = LaunchpadLedMessage<Model>::ADDRESSES.address[index];
+	switch (leds->mode[index])
+	{
+		case LAUNCHPAD_LED_FLASH:
+			// Flashes between the palette colour and off
+			output[0] = 0x01;
+			output[2] = leds->palette[index];
+			output[3] = 0;
+			return 4;
+		case LAUNCHPAD_LED_PULSE:
+			output[0] = 0x02;
+			output[2] = leds->palette[index];
+			return 3;
+		default:
+			output[0] = 0x00;
+			output[2] = leds->palette[index];
+			return 3;
+	}
+}
+
+// Builds the messages that send the LEDs that differ from what we last sent.
+// These are whichever way costs the least: either LEDs lit with a palette
+// colour (including all flashing and pulsing LEDs) as note/CC messages and the
+// rest in a SysEx message, or (for models with typed entries) everything in
+// one SysEx message. This is instantiated once per model so that the message
+// layout is fixed at compile time
+template <typename Model> static size_t stack_launchpad_trigger_encode_leds_model(LaunchpadLeds *leds, LaunchpadLedOutput *output)
+{
+	size_t short_length = 0;
+	size_t sysex_length = stack_launchpad_trigger_write_header<Model>(output->sysex_data, &Model::LED_COMMAND, 1);
+	const size_t sysex_header_length = sysex_length;
+
+	// Find the LEDs that differ from what the device is showing (changes can
+	// be undone before they're sent), and what each way of sending them costs
+	uint8_t changed[LAUNCHPAD_MAX_BUTTONS];
+	size_t changed_count = 0, rgb_count = 0;
+	size_t short_bytes = 0, short_messages = 0, palette_entry_bytes = 0;
+	for (size_t i = 0; i < LAUNCHPAD_MAX_BUTTONS; i++)
+	{
+		if (!leds->dirty[i])
+		{
+			continue;
+		}
+		leds->dirty[i] = false;
+
+		LaunchpadFrameButton *sent = &leds->sent[i];
+		if (LaunchpadLedMessage<Model>::ADDRESSES.address[i] == 0 || (sent->mode == leds->mode[i] && sent->r == leds->r[i] && sent->g == leds->g[i] && sent->b == leds->b[i]))
+		{
+			continue;
+		}
+		*sent = {leds->mode[i], leds->r[i], leds->g[i], leds->b[i]};
+		changed[changed_count++] = i;
+
+		if (leds->mode[i] == LAUNCHPAD_LED_STATIC && !leds->palette_exact[i])
+		{
+			rgb_count++;
+		}
+		else if (leds->mode[i] == LAUNCHPAD_LED_FLASH)
+		{
+			short_bytes += 6;
+			short_messages += 2;
+			palette_entry_bytes += 4;
+		}
+		else
+		{
+			short_bytes += 3;
+			short_messages++;
+			palette_entry_bytes += 3;
+		}
+	}
+
+	// The cost of each way is the bytes it takes plus one for each message,
+	// as the device handles each message separately, so that ties go to the
+	// fewest messages
+	const size_t sysex_cost = sysex_header_length + 1 + 1;
+	const size_t rgb_bytes = rgb_count * (Model::TYPED_ENTRIES ? 5 : 4);
+	const size_t split_cost = short_bytes + short_messages + (rgb_count > 0 ? sysex_cost + rgb_bytes : 0);
+	const size_t single_cost = sysex_cost + rgb_bytes + palette_entry_bytes;
+	const bool single_sysex = Model::TYPED_ENTRIES && single_cost <= split_cost;
+
+	// Scale every colour down to what the device takes up front. These are
+	// straight passes over each colour that the compiler can vectorise, which
+	// is cheaper than scaling button by button when most of the grid changes
+	uint8_t device_r[LAUNCHPAD_MAX_BUTTONS];
+	uint8_t device_g[LAUNCHPAD_MAX_BUTTONS];
+	uint8_t device_b[LAUNCHPAD_MAX_BUTTONS];
+	for (size_t i = 0; i < LAUNCHPAD_MAX_BUTTONS; i++)
+	{
+		device_r[i] = leds->r[i] >> Model::COLOUR_SHIFT;
+		device_g[i] = leds->g[i] >> Model::COLOUR_SHIFT;
+		device_b[i] = leds->b[i] >> Model::COLOUR_SHIFT;
+	}
+
+	for (size_t c = 0; c < changed_count; c++)
+	{
+		const int i = changed[c];
+		if (leds->mode[i] != LAUNCHPAD_LED_STATIC || leds->palette_exact[i])
+		{
+			if constexpr (Model::TYPED_ENTRIES)
+			{
+				if (single_sysex)
+				{
+					sysex_length += stack_launchpad_trigger_write_sysex_palette_led<Model>(&output->sysex_data[sysex_length], leds, i);
+					continue;
+				}
+			}
+			short_length += stack_launchpad_trigger_write_short_led<Model>(&output->short_data[short_length], leds, i);
+			continue;
+		}
+
+		if constexpr (Model::TYPED_ENTRIES)
+		{
+			output->sysex_data[sysex_length++] = 0x03;
+		}
+		output->sysex_data[sysex_length + 0] = LaunchpadLedMessage<Model>::ADDRESSES.address[i];
+		output->sysex_data[sysex_length + 1] = device_r[i];
+		output->sysex_data[sysex_length + 2] = device_g[i];
+		output->sysex_data[sysex_length + 3] = device_b[i];
+		sysex_length += 4;
+	}
+
+	if (sysex_length == sysex_header_length)
+	{
+		sysex_length = 0;
+	}
+	else
+	{
+		output->sysex_data[sysex_length++] = MIDI_SYSEX_END;
+	}
+
+	output->short_length = short_length;
+	output->short_messages = single_sysex ? 0 : short_messages;
+	output->sysex_length = sysex_length;
+	return changed_count;
+}
+
+// Writes the message that puts the device in to the layout that our addresses
+// and note/CC lighting messages are for
+template <typename Model> static size_t stack_launchpad_trigger_encode_programmer_mode_model(unsigned char *output)
+{
+	size_t offset = stack_launchpad_trigger_write_header<Model>(output, Model::PROGRAMMER_MODE, sizeof(Model::PROGRAMMER_MODE));
+	output[offset++] = MIDI_SYSEX_END;
+	return offset;
+}
+
+// Builds the runtime profile for a model
+template <typename Model> static constexpr LaunchpadProfile stack_launchpad_trigger_make_profile(const char *match)
+{
+	return {Model::NAME, match, Model::COLUMNS, Model::ROWS, &Model::address_to_col_row, &stack_launchpad_trigger_encode_leds_model<Model>, &stack_launchpad_trigger_encode_programmer_mode_model<Model>};
+}
+
+// The models we support. These are matched in order, so more specific names
+// must come first. The first entry is also used for unrecognised models
+static const LaunchpadProfile launchpad_profiles[] = {
+	stack_launchpad_trigger_make_profile<LaunchpadModelX>("Launchpad X"),
+	stack_launchpad_trigger_make_profile<LaunchpadModelMiniMk3>("Mini MK3"),
+	stack_launchpad_trigger_make_profile<LaunchpadModelProMk3>("Pro MK3"),
+	stack_launchpad_trigger_make_profile<LaunchpadModelMk2>("MK2"),
+	stack_launchpad_trigger_make_profile<LaunchpadModelX>("LPX"),
+	stack_launchpad_trigger_make_profile<LaunchpadModelMiniMk3>("LPMiniMK3"),
+	stack_launchpad_trigger_make_profile<LaunchpadModelProMk3>("LPProMK3"),
+};
+
+// Returns the profile for a device based on its ALSA rawmidi name, or (as some
+// models only identify themselves there) its subdevice name. Unrecognised
+// devices are treated as a Launchpad X
+const LaunchpadProfile *stack_launchpad_trigger_find_profile(const char *name, const char *subdevice_name)
+{
+	for (auto &profile : launchpad_profiles)
+	{
+		if (strstr(name, profile.match) != NULL || strstr(subdevice_name, profile.match) != NULL)
+		{
+			return &profile;
+		}
+	}
+
+	return &launchpad_profiles[0];
+}
@@ -0,0 +1,504 @@
+#ifndef LAUNCHPADCORE_H_INCLUDED
+#define LAUNCHPADCORE_H_INCLUDED
+
+// The parts of the Launchpad trigger that don't need GTK or Stack: the models
+// we support, the MIDI parser, how LEDs are lit and the messages that light
+// them, and the dispatch index. These build in to the launchpad-core library,
+// which the plugin, the benchmark and the fuzzer all link against
+
+// Includes:
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Definitions - MIDI events:
+#define MIDI_NOTE_OFF         0x80
+#define MIDI_NOTE_ON          0x90
+#define MIDI_POLY_AFTERTOUCH  0xa0
+#define MIDI_CONTROL_CHANGE   0xb0
+#define MIDI_PROGRAM_CHANGE   0xc0
+#define MIDI_CHANNEL_PRESSURE 0xd0
+#define MIDI_SYSEX            0xf0
+#define MIDI_SYSEX_END        0xf7
+#define MIDI_REALTIME         0xf8
+
+// Definitions: Global button indices:
+#define GLOBAL_BUTTON_INDEX_UP       0
+#define GLOBAL_BUTTON_INDEX_DOWN     1
+#define GLOBAL_BUTTON_INDEX_LEFT     2
+#define GLOBAL_BUTTON_INDEX_RIGHT    3
+#define GLOBAL_BUTTON_INDEX_GO       4
+#define GLOBAL_BUTTON_INDEX_STOP_ALL 5
+#define GLOBAL_BUTTON_COUNT          6
+
+// Definitions: The largest grid of any supported device
+#define LAUNCHPAD_MAX_COLUMNS 9
+#define LAUNCHPAD_MAX_ROWS    9
+#define LAUNCHPAD_MAX_BUTTONS (LAUNCHPAD_MAX_COLUMNS * LAUNCHPAD_MAX_ROWS)
+
+// Definitions: The maximum number of pages of triggers on a device. Pages are
+// selected with the buttons at the right of the top row (excluding the logo),
+// which is also where this limit comes from. Page buttons skip any global
+// buttons and triggers there, carrying on down the right-hand column if they
+// run out
+#define LAUNCHPAD_MAX_PAGES 8
+
+// Definitions: The largest LED messages that we build for any model, i.e.
+// ones that change every button (see LaunchpadLedMessage), and the largest
+// programmer mode message
+#define LAUNCHPAD_MAX_SHORT_SIZE           (LAUNCHPAD_MAX_BUTTONS * 6)
+#define LAUNCHPAD_MAX_SYSEX_SIZE           (8 + LAUNCHPAD_MAX_BUTTONS * 5 + 1)
+#define LAUNCHPAD_MAX_PROGRAMMER_MODE_SIZE 16
+
+// Definitions: The number of bits of each colour component used to look up the
+// nearest palette colour
+#define LAUNCHPAD_PALETTE_LUT_BITS 4
+
+// Definitions: The MIDI channels that light a button with a palette colour in
+// programmer mode, for each lighting type
+#define LAUNCHPAD_LED_CHANNEL_STATIC 0
+#define LAUNCHPAD_LED_CHANNEL_FLASH  1
+#define LAUNCHPAD_LED_CHANNEL_PULSE  2
+
+// Typedefs: How the LED of a button is lit. The flashing and pulsing modes are
+// animated by the device itself, using its palette
+typedef enum LaunchpadLedMode
+{
+	LAUNCHPAD_LED_STATIC = 0,
+	LAUNCHPAD_LED_FLASH,
+	LAUNCHPAD_LED_PULSE,
+
+	// Only used for what we last sent to a device, when we don't know what
+	// the device is showing
+	LAUNCHPAD_LED_UNKNOWN = 0xFF,
+} LaunchpadLedMode;
+
+// Typedefs: A complete MIDI message read from the device (data bytes that are
+// not used by the message are zero)
+typedef struct LaunchpadMidiMessage
+{
+	uint8_t status;
+	uint8_t data[2];
+} LaunchpadMidiMessage;
+
+// Typedefs: State of the MIDI parser, which persists between reads so that
+// messages split across reads are not lost
+typedef struct LaunchpadMidiParser
+{
+	// The current (running) status byte, or zero if we have none
+	uint8_t status;
+
+	// The data bytes received so far for the current message
+	uint8_t data[2];
+	uint8_t data_count;
+
+	// The number of data bytes the current message needs
+	uint8_t data_needed;
+
+	// Whether we're currently skipping over a SysEx message
+	bool in_sysex;
+
+	// The number of channel messages that were cut short by another status
+	// byte, which the reader takes and clears
+	uint32_t incomplete_count;
+} LaunchpadMidiParser;
+
+// Typedefs: A list of triggers bound to a single button. The triggers are only
+// ever pointed to here, so the core doesn't need to know what they are
+struct StackLaunchpadTrigger;
+typedef std::vector<StackLaunchpadTrigger*> LaunchpadTriggerVector;
+
+// Typedefs: Details of the global buttons
+typedef struct LaunchpadGlobalButton {
+	uint8_t column;
+	uint8_t row;
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+} LaunchpadGlobalButton;
+
+// Typedefs: How a button is lit when not pressed
+typedef struct LaunchpadFrameButton
+{
+	uint8_t mode;
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+} LaunchpadFrameButton;
+
+// Typedefs: How the LEDs of a device are lit, with an array for each property
+// indexed by stack_launchpad_trigger_button_index(). Keeping each colour in
+// its own array lets a whole grid be scaled for the device in straight
+// (vectorisable) passes, rather than a call and a lookup per button. All of
+// this is guarded by led_mutex
+typedef struct LaunchpadLeds
+{
+	// How each LED is lit
+	uint8_t mode[LAUNCHPAD_MAX_BUTTONS];
+	uint8_t r[LAUNCHPAD_MAX_BUTTONS];
+	uint8_t g[LAUNCHPAD_MAX_BUTTONS];
+	uint8_t b[LAUNCHPAD_MAX_BUTTONS];
+
+	// The nearest palette colour to each LED, and whether that palette colour
+	// is exact. LEDs lit with a palette colour are sent as short note/CC
+	// messages rather than SysEx
+	uint8_t palette[LAUNCHPAD_MAX_BUTTONS];
+	bool palette_exact[LAUNCHPAD_MAX_BUTTONS];
+
+	// Whether each LED has changed but not yet been sent to the device
+	bool dirty[LAUNCHPAD_MAX_BUTTONS];
+
+	// How each LED is lit when its button isn't being pressed, which we
+	// return to when it is released
+	LaunchpadFrameButton base[LAUNCHPAD_MAX_BUTTONS];
+
+	// How each LED was last sent to the device, so that we only send those
+	// that differ from it
+	LaunchpadFrameButton sent[LAUNCHPAD_MAX_BUTTONS];
+} LaunchpadLeds;
+
+// Typedefs: How presses of a button are debounced and repeated. This is made
+// up from the settings of all the triggers on the button, as they share the
+// button's timing
+typedef struct LaunchpadButtonPolicy
+{
+	// The minimum time between presses triggering the cues, in nanoseconds
+	// (the same as a stack_time_t)
+	int64_t interval;
+
+	// Whether presses that come too soon are queued rather than ignored
+	bool queue;
+
+	// Whether holding the button down repeats it every interval
+	bool hold;
+} LaunchpadButtonPolicy;
+
+// Typedefs: The triggers on one page of a device
+typedef struct LaunchpadPage
+{
+	// The triggers on the page indexed by the button they are bound to, so
+	// that the thread only has to look at the triggers for the button that
+	// was pressed
+	LaunchpadTriggerVector button_triggers[LAUNCHPAD_MAX_BUTTONS];
+
+	// The timing policy of each button, indexed the same as button_triggers
+	LaunchpadButtonPolicy button_policies[LAUNCHPAD_MAX_BUTTONS];
+} LaunchpadPage;
+
+// Typedefs: An immutable snapshot of everything the MIDI thread needs to
+// dispatch button presses for a device. Writers build a new table and swap it
+// in, so the MIDI thread never needs to take a lock to read one
+typedef struct LaunchpadDispatchTable
+{
+	// The pages of triggers bound to the device. There is always at least one
+	// page, and the page buttons are only used if there is more than one
+	std::vector<LaunchpadPage> pages;
+
+	// The triggers bound to the device that have cue list controls enabled
+	LaunchpadTriggerVector cue_list_triggers;
+
+	// A copy of the global buttons at the time the table was built
+	LaunchpadGlobalButton global_buttons[GLOBAL_BUTTON_COUNT];
+
+	// The button index of the button that selects each page, of which there
+	// are none with only one page, and the other way around the page (plus
+	// one, so that zero is no page) that each button selects. Set by
+	// stack_launchpad_trigger_place_page_buttons once the pages and global
+	// buttons are
+	size_t page_button_count;
+	uint8_t page_buttons[LAUNCHPAD_MAX_PAGES];
+	uint8_t button_pages[LAUNCHPAD_MAX_BUTTONS];
+} LaunchpadDispatchTable;
+
+// Typedefs: Per-model details of the Launchpads we support. Everything in
+// here is a compile-time constant so that the message building code (which is
+// instantiated once per model) never has to check which model it is talking
+// to. The SysEx details are taken from the programmer's reference manuals:
+// https://fael-downloads-prod.focusrite.com/customer/prod/s3fs-public/downloads/Launchpad%20X%20-%20Programmers%20Reference%20Manual.pdf
+struct LaunchpadModelX
+{
+	static constexpr const char *NAME = "Launchpad X";
+	static constexpr unsigned char HEADER[] = {MIDI_SYSEX, 0x00, 0x20, 0x29, 0x02, 0x0C};
+	static constexpr uint8_t COLUMNS = 9;
+	static constexpr uint8_t ROWS = 9;
+
+	// Our colours are 0-255, the device's are 0-127
+	static constexpr uint8_t COLOUR_SHIFT = 1;
+
+	// The SysEx command for lighting buttons, and whether each entry in it
+	// starts with its lighting type. Typed entries can be palette colours
+	// (static, flashing or pulsing) as well as exact colours
+	static constexpr unsigned char LED_COMMAND = 0x03;
+	static constexpr bool TYPED_ENTRIES = true;
+
+	// Selects programmer mode, which the addresses below are for
+	static constexpr unsigned char PROGRAMMER_MODE[] = {0x0E, 0x01};
+
+	// The top row and right column are lit with CCs rather than notes
+	static constexpr bool is_control(uint8_t column, uint8_t row)
+	{
+		return row == 1 || column == 9;
+	}
+
+	// The top row is sent as CCs 91-99 and the rest as notes, but all use the
+	// same numbering scheme
+	static constexpr unsigned char col_row_to_address(uint8_t column, uint8_t row)
+	{
+		return (10 - row) * 10 + column;
+	}
+
+	static constexpr bool address_to_col_row(unsigned char address, uint8_t *column, uint8_t *row)
+	{
+		if (address < 11 || address > 99)
+		{
+			return false;
+		}
+		*row = 10 - ((address - 1) / 10);
+		*column = (address % 10);
+		return true;
+	}
+};
+
+// The Mini MK3 is identical to the X bar the header
+struct LaunchpadModelMiniMk3 : LaunchpadModelX
+{
+	static constexpr const char *NAME = "Launchpad Mini MK3";
+	static constexpr unsigned char HEADER[] = {MIDI_SYSEX, 0x00, 0x20, 0x29, 0x02, 0x0D};
+};
+
+// The Pro MK3 has an extra column on the left and an extra row at the bottom,
+// which we don't (yet) support, but otherwise uses the same scheme as the X
+// for the 9x9 buttons that the other models have
+struct LaunchpadModelProMk3 : LaunchpadModelX
+{
+	static constexpr const char *NAME = "Launchpad Pro MK3";
+	static constexpr unsigned char HEADER[] = {MIDI_SYSEX, 0x00, 0x20, 0x29, 0x02, 0x0E};
+};
+
+// The MK2 has 6-bit colours, no lighting type in its RGB entries, and its top
+// row is sent as CCs 104-111. It has no programmer mode, but its session
+// layout uses the same addresses. It has no button in the top-right
+struct LaunchpadModelMk2
+{
+	static constexpr const char *NAME = "Launchpad MK2";
+	static constexpr unsigned char HEADER[] = {MIDI_SYSEX, 0x00, 0x20, 0x29, 0x02, 0x18};
+	static constexpr uint8_t COLUMNS = 9;
+	static constexpr uint8_t ROWS = 9;
+	static constexpr uint8_t COLOUR_SHIFT = 2;
+	static constexpr unsigned char LED_COMMAND = 0x0B;
+	static constexpr bool TYPED_ENTRIES = false;
+	static constexpr unsigned char PROGRAMMER_MODE[] = {0x22, 0x00};
+
+	static constexpr bool is_control(uint8_t, uint8_t row)
+	{
+		return row == 1;
+	}
+
+	// Returns zero for the missing top-right button
+	static constexpr unsigned char col_row_to_address(uint8_t column, uint8_t row)
+	{
+		if (row == 1)
+		{
+			return column < 9 ? 103 + column : 0;
+		}
+		return (10 - row) * 10 + column;
+	}
+
+	static constexpr bool address_to_col_row(unsigned char address, uint8_t *column, uint8_t *row)
+	{
+		if (address >= 104 && address <= 111)
+		{
+			*row = 1;
+			*column = address - 103;
+			return true;
+		}
+		if (address < 11 || address > 89)
+		{
+			return false;
+		}
+		*row = 10 - ((address - 1) / 10);
+		*column = (address % 10);
+		return true;
+	}
+};
+
+// Typedefs: The address of each button of a model (or zero if the model
+// doesn't have the button), and whether it is lit with a CC rather than a
+// note, indexed by stack_launchpad_trigger_button_index()
+typedef struct LaunchpadAddressTable
+{
+	unsigned char address[LAUNCHPAD_MAX_BUTTONS];
+	bool control[LAUNCHPAD_MAX_BUTTONS];
+} LaunchpadAddressTable;
+
+// Builds the address table for a model at compile time
+template <typename Model> constexpr LaunchpadAddressTable stack_launchpad_trigger_make_address_table()
+{
+	LaunchpadAddressTable table = {};
+	for (uint8_t row = 1; row <= Model::ROWS; row++)
+	{
+		for (uint8_t column = 1; column <= Model::COLUMNS; column++)
+		{
+			const size_t index = (row - 1) * LAUNCHPAD_MAX_COLUMNS + column - 1;
+			table.address[index] = Model::col_row_to_address(column, row);
+			table.control[index] = Model::is_control(column, row);
+		}
+	}
+	return table;
+}
+
+// The largest LED messages we could possibly need to send to a given model,
+// i.e. ones that change every button, and the addresses that they use
+template <typename Model> struct LaunchpadLedMessage
+{
+	static_assert(Model::COLUMNS <= LAUNCHPAD_MAX_COLUMNS && Model::ROWS <= LAUNCHPAD_MAX_ROWS, "Model is larger than the grid");
+
+	// Palette colours take one three-byte message per button, or two when
+	// flashing (as the colour to flash with has to be set to off first)
+	static constexpr size_t MAX_SHORT_SIZE = Model::COLUMNS * Model::ROWS * 6;
+
+	// Exact colours are sent in one SysEx message: the header, command, an
+	// entry per button (with or without its lighting type) and terminator
+	static constexpr size_t MAX_SYSEX_SIZE = sizeof(Model::HEADER) + 1 + Model::COLUMNS * Model::ROWS * (Model::TYPED_ENTRIES ? 5 : 4) + 1;
+
+	static constexpr LaunchpadAddressTable ADDRESSES = stack_launchpad_trigger_make_address_table<Model>();
+
+	static_assert(MAX_SHORT_SIZE <= LAUNCHPAD_MAX_SHORT_SIZE && MAX_SYSEX_SIZE <= LAUNCHPAD_MAX_SYSEX_SIZE, "Model's LED messages are larger than LaunchpadLedOutput");
+	static_assert(sizeof(Model::HEADER) + sizeof(Model::PROGRAMMER_MODE) + 1 <= LAUNCHPAD_MAX_PROGRAMMER_MODE_SIZE, "Model's programmer mode message is too large");
+};
+
+// Typedefs: The messages that light the changed LEDs of a device. Either part
+// may be empty
+typedef struct LaunchpadLedOutput
+{
+	// Note/CC messages lighting LEDs with palette colours, and the number of
+	// messages
+	unsigned char short_data[LAUNCHPAD_MAX_SHORT_SIZE];
+	size_t short_length;
+	size_t short_messages;
+
+	// A single SysEx message
+	unsigned char sysex_data[LAUNCHPAD_MAX_SYSEX_SIZE];
+	size_t sysex_length;
+} LaunchpadLedOutput;
+
+// Typedefs: The runtime view of a model, which devices point to
+typedef struct LaunchpadProfile
+{
+	const char *name;
+
+	// The ALSA name must contain this to match this profile
+	const char *match;
+
+	uint8_t columns;
+	uint8_t rows;
+
+	// Returns false if the address is not a button we support
+	bool (*address_to_col_row)(unsigned char address, uint8_t *column, uint8_t *row);
+
+	// Builds the messages that send the dirty LEDs that differ from what was
+	// last sent, clearing their dirty flags and recording them as sent.
+	// Returns the number of LEDs in the messages
+	size_t (*encode_leds)(LaunchpadLeds *leds, LaunchpadLedOutput *output);
+
+	// Writes the message that puts the device in to the layout our addresses
+	// are for (at most LAUNCHPAD_MAX_PROGRAMMER_MODE_SIZE bytes), returning
+	// its length
+	size_t (*encode_programmer_mode)(unsigned char *output);
+} LaunchpadProfile;
+
+// Typedefs: What a button of a device does, according to a dispatch table
+typedef struct LaunchpadButtonTarget
+{
+	// The button, and its index within the pages of the table
+	uint8_t column;
+	uint8_t row;
+	int index;
+
+	// The page (0-based) that the button selects, or -1 if it isn't a page
+	// button
+	int page_button;
+
+	// The global button it is, or NULL if it isn't one. There are no global
+	// buttons unless a trigger on the device has cue list controls enabled
+	const LaunchpadGlobalButton *global_button;
+
+	// The page being shown, which the triggers on the button are looked up in
+	const LaunchpadPage *page;
+} LaunchpadButtonTarget;
+
+////////////////////////////////////////////////////////////////////////////////
+// TRIGGER INDEX
+
+// Returns the index of a button (by its column/row, 1-9) within the trigger
+// index, or -1 if the button is outside of the grid
+static inline int stack_launchpad_trigger_button_index(uint8_t column, uint8_t row)
+{
+	if (column < 1 || row < 1 || column > LAUNCHPAD_MAX_COLUMNS || row > LAUNCHPAD_MAX_ROWS)
+	{
+		return -1;
+	}
+
+	return (row - 1) * LAUNCHPAD_MAX_COLUMNS + column - 1;
+}
+
+// Chooses which buttons select the pages of a dispatch table. Page buttons are
+// at the right of the top row, in order, and only exist with multiple pages.
+// They never share a button with a global button, and only share one with a
+// trigger if there aren't enough buttons otherwise: those are skipped, and if
+// that leaves too few in the top row, the rest go down the right-hand column.
+// Call this once the pages have their triggers
+void stack_launchpad_trigger_place_page_buttons(LaunchpadDispatchTable *table);
+
+// Returns the page (0-based) selected by the button at the given column/row
+// within a dispatch table, or -1 if it isn't a page button
+int stack_launchpad_trigger_get_page_button(const LaunchpadDispatchTable *table, uint8_t column, uint8_t row);
+
+// Returns the global button at the given column/row within a dispatch table,
+// or NULL if there isn't one
+const LaunchpadGlobalButton *stack_launchpad_trigger_get_global_button(const LaunchpadDispatchTable *table, uint8_t column, uint8_t row);
+
+// Returns a page (0-based) of a dispatch table, or the first page if the table
+// doesn't have that many (as it may have been rebuilt with fewer pages since
+// the page was chosen)
+const LaunchpadPage *stack_launchpad_trigger_get_page(const LaunchpadDispatchTable *table, size_t page);
+
+// Finds what the button at an address of a device with the given profile
+// does, whilst the given page is shown. Returns false if the address isn't a
+// button of the device. This never reads outside of the table, whatever the
+// address
+bool stack_launchpad_trigger_resolve_button(const LaunchpadProfile *profile, const LaunchpadDispatchTable *table, size_t shown_page, uint8_t address, LaunchpadButtonTarget *target);
+
+////////////////////////////////////////////////////////////////////////////////
+// MIDI PARSER
+
+// Resets the parser to its initial state, discarding any partial message
+void stack_launchpad_trigger_parser_reset(LaunchpadMidiParser *parser);
+
+// Feeds a single byte read from the device in to the parser. Returns true and
+// fills in message if the byte completes a channel message. SysEx messages,
+// system common messages and real-time messages are all consumed silently
+bool stack_launchpad_trigger_parse_byte(LaunchpadMidiParser *parser, uint8_t byte, LaunchpadMidiMessage *message);
+
+// Returns whether a message is a button being pressed or released, and if so
+// gives its pressure. Buttons send a note on or a controller change, and a
+// note off is a release (with zero pressure) whatever its velocity
+bool stack_launchpad_trigger_button_pressure(const LaunchpadMidiMessage *message, uint8_t *pressure);
+
+////////////////////////////////////////////////////////////////////////////////
+// LEDS
+
+// Returns the index of the colour in the Launchpad palette that is closest to
+// the given colour
+uint8_t stack_launchpad_trigger_palette_index(uint8_t r, uint8_t g, uint8_t b);
+
+// Changes how an LED is lit, along with its nearest palette colour. Returns
+// false if the LED was already lit that way
+bool stack_launchpad_trigger_light_led(LaunchpadLeds *leds, int index, uint8_t mode, uint8_t r, uint8_t g, uint8_t b);
+
+// Returns the profile for a device based on its ALSA rawmidi name, or (as some
+// models only identify themselves there) its subdevice name. Unrecognised
+// devices are treated as a Launchpad X
+const LaunchpadProfile *stack_launchpad_trigger_find_profile(const char *name, const char *subdevice_name);
+
+#endif
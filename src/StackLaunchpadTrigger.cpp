@@ -2,688 +2,3515 @@
 #include "StackApp.h"
 #include "StackLog.h"
 #include "StackLaunchpadTrigger.h"
+#include "LaunchpadCore.h"
 #include "StackGtkHelper.h"
 #include "StackJson.h"
 #include <list>
+#include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <charconv>
 #include "alsa/asoundlib.h"
+#include <glib-unix.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+// Definitions: The maximum number of devices we'll use at once
+#define LAUNCHPAD_MAX_DEVICES 8
+
+// Definitions: How often we rescan for a missing device. If we can receive
+// ALSA sequencer announcements we get told when a device is plugged in, and
+// so only need to rescan occasionally
+#define DEVICE_RESCAN_INTERVAL_MS          1000
+#define DEVICE_RESCAN_INTERVAL_ANNOUNCE_MS 10000
+
+// Definitions: The size of the buffer we read from the device in to. This is
+// large enough to drain a burst of aftertouch messages in one read
+#define LAUNCHPAD_READ_BUFFER_SIZE 1024
+
+// Definitions: The minimum time between LED updates being sent to the device.
+// Any colour changes made within this time are coalesced in to one message
+#define LED_FLUSH_INTERVAL_MS 10
+
+// Definitions: The number of actions that can be waiting to be run on the UI
+// thread. This must be a power of two
+#define LAUNCHPAD_ACTION_QUEUE_SIZE 256
+
+// Definitions: The minimum time between pressure changes being applied to a
+// cue. Aftertouch arrives far faster than this, so only the latest pressure
+// for each button is applied at this rate
+#define LAUNCHPAD_PRESSURE_INTERVAL_MS 20
+
+// Definitions: The volume (in dB) that the lightest press maps to
+#define LAUNCHPAD_PRESSURE_MIN_DB -40.0
+
+// Definitions: The default minimum time between presses of a button that
+// trigger a cue
+#define LAUNCHPAD_DEFAULT_DEBOUNCE_MS 50
+
+// Definitions: The longest fixed latency that trigger actions can be
+// scheduled with
+#define LAUNCHPAD_MAX_START_OFFSET_MS 1000
+
+// Definitions: The range of press velocities. Devices without velocity
+// sensitivity always send the maximum
+#define LAUNCHPAD_VELOCITY_MIN 1
+#define LAUNCHPAD_VELOCITY_MAX 127
+
+// Definitions: How often we look for changes in the state of cues that show
+// their state on their buttons, which Stack doesn't tell us about (such as
+// cues finishing). This only happens whilst there are such triggers
+#define LAUNCHPAD_FEEDBACK_INTERVAL_MS 50
+
+// Definitions: The minimum time between presses of a global button that are
+// acted on. Later presses are ignored, so that GO can't be double-triggered
+#define LAUNCHPAD_GLOBAL_BUTTON_LOCKOUT_MS 250
+
+// Definitions: The SCHED_FIFO priority the MIDI thread runs at when real-time
+// priority is enabled. This is kept below the priorities that audio servers
+// tend to use, so that we never starve the audio of a show
+#define LAUNCHPAD_REALTIME_PRIORITY 40
+
+// Definitions: How much of the MIDI thread's stack is locked in to memory when
+// memory locking is enabled
+#define LAUNCHPAD_LOCKED_STACK_SIZE (64 * 1024)
+
+// Definitions: Each latency histogram has 2^LAUNCHPAD_LATENCY_SUB_BUCKET_BITS
+// buckets for each power of two microseconds, up to 2^LAUNCHPAD_LATENCY_MAX_POWER
+// microseconds (about a second). Anything slower goes in the last bucket
+#define LAUNCHPAD_LATENCY_SUB_BUCKET_BITS 2
+#define LAUNCHPAD_LATENCY_MAX_POWER       20
+#define LAUNCHPAD_LATENCY_BUCKETS         ((LAUNCHPAD_LATENCY_MAX_POWER - LAUNCHPAD_LATENCY_SUB_BUCKET_BITS + 2) << LAUNCHPAD_LATENCY_SUB_BUCKET_BITS)
+
+// Definitions: The size of the buffer that the latency report is written in to
+#define LAUNCHPAD_LATENCY_REPORT_SIZE 1024
+
+// Definitions: How often the global settings dialog refreshes the device
+// statistics, and the size of the buffer that they are written in to
+#define LAUNCHPAD_STATS_INTERVAL_MS 1000
+#define LAUNCHPAD_STATS_REPORT_SIZE 2048
+
+// Definitions: MIDI captures. Records are queued in memory for the capture
+// thread, which writes them to a file that wraps around once it holds
+// LAUNCHPAD_CAPTURE_FILE_RECORDS records (16MiB)
+#define LAUNCHPAD_CAPTURE_MAGIC        "LPADCAP"
+#define LAUNCHPAD_CAPTURE_VERSION      1
+#define LAUNCHPAD_CAPTURE_DATA_SIZE    52
+#define LAUNCHPAD_CAPTURE_QUEUE_SIZE   4096
+#define LAUNCHPAD_CAPTURE_FILE_RECORDS (256 * 1024)
+#define LAUNCHPAD_CAPTURE_INTERVAL_MS  100
+
+// Typedefs: The cue states that buttons show, in increasing order of
+// precedence for when more than one cue shares a button
+typedef enum LaunchpadFeedbackState
+{
+	LAUNCHPAD_FEEDBACK_IDLE = 0,
+	LAUNCHPAD_FEEDBACK_PAUSED,
+	LAUNCHPAD_FEEDBACK_PRE_WAIT,
+	LAUNCHPAD_FEEDBACK_PLAYING,
+} LaunchpadFeedbackState;
+
+// Typedefs: The stages of handling a button press that we measure the
+// latency of
+typedef enum LaunchpadLatencyStage
+{
+	// From ALSA timestamping a message to us reading it. This is only
+	// measured if ALSA supports timestamps
+	LAUNCHPAD_LATENCY_READ = 0,
+
+	// From reading a message to having parsed it
+	LAUNCHPAD_LATENCY_PARSE,
+
+	// From parsing a press to having found its triggers
+	LAUNCHPAD_LATENCY_DISPATCH,
+
+	// From finding the triggers to having queued their actions
+	LAUNCHPAD_LATENCY_ENQUEUE,
+
+	// From queuing an action to the UI thread having run it
+	LAUNCHPAD_LATENCY_EXECUTE,
+
+	// From a press to the pressed colour being sent to the device
+	LAUNCHPAD_LATENCY_ECHO,
+
+	// From a press (or when a queued or repeated press was due) to its action
+	// having been run
+	LAUNCHPAD_LATENCY_TOTAL,
+
+	LAUNCHPAD_LATENCY_STAGE_COUNT,
+} LaunchpadLatencyStage;
+
+// Typedefs: A histogram of the latency of a stage. Each stage only has one
+// thread recording it, but any thread can read it
+typedef struct LaunchpadLatencyHistogram
+{
+	std::atomic<uint32_t> counts[LAUNCHPAD_LATENCY_BUCKETS];
+
+	// The largest measurement, in microseconds
+	std::atomic<uint64_t> max;
+} LaunchpadLatencyHistogram;
+
+// Typedefs: The types of record in a MIDI capture. Values are stored in capture
+// files, so must not be renumbered
+typedef enum LaunchpadCaptureType
+{
+	// Bytes read from the device
+	LAUNCHPAD_CAPTURE_IN = 0,
+
+	// Bytes written to the device
+	LAUNCHPAD_CAPTURE_OUT = 1,
+
+	// The device was opened or closed (these have no data)
+	LAUNCHPAD_CAPTURE_OPENED = 2,
+	LAUNCHPAD_CAPTURE_CLOSED = 3,
+} LaunchpadCaptureType;
+
+// Typedefs: A record in a MIDI capture, as stored in the file. Reads and
+// writes longer than LAUNCHPAD_CAPTURE_DATA_SIZE are split over several
+// records with the same time
+typedef struct LaunchpadCaptureRecord
+{
+	// Nanoseconds since the capture started
+	int64_t time;
+
+	// The index of the device, a LaunchpadCaptureType, and the number of
+	// bytes of data used
+	uint8_t device;
+	uint8_t type;
+	uint8_t length;
+	uint8_t reserved;
+
+	unsigned char data[LAUNCHPAD_CAPTURE_DATA_SIZE];
+} LaunchpadCaptureRecord;
+
+// Typedefs: The start of a capture file, which is followed by the records
+typedef struct LaunchpadCaptureHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+
+	// The number of records the file holds before it wraps around, and the
+	// number of records that have been written in total. Once more than
+	// capacity have been written, the oldest is at (written % capacity)
+	uint64_t capacity;
+	uint64_t written;
+} LaunchpadCaptureHeader;
+
+// Typedefs: A slot in the queue of capture records. The sequence number says
+// whether the slot is free to be written or waiting to be read
+typedef struct LaunchpadCaptureSlot
+{
+	std::atomic<size_t> sequence;
+	LaunchpadCaptureRecord record;
+} LaunchpadCaptureSlot;
+
+// Typedefs: A bounded, lock-free queue of capture records. Any thread can add
+// to it (without blocking), and only the capture thread reads from it
+typedef struct LaunchpadCaptureQueue
+{
+	LaunchpadCaptureSlot slots[LAUNCHPAD_CAPTURE_QUEUE_SIZE];
+	std::atomic<size_t> head;
+	size_t tail;
+
+	// The number of records that we couldn't queue as it was full
+	std::atomic<uint64_t> dropped;
+} LaunchpadCaptureQueue;
+
+// Typedefs: The types of action that can be queued for the UI thread
+typedef enum LaunchpadActionType
+{
+	// Run the action of the trigger on its cue
+	LAUNCHPAD_ACTION_TRIGGER,
+
+	// Stop all the cues in the cue list of the trigger
+	LAUNCHPAD_ACTION_STOP_ALL,
+
+	// Run a cue list command in the window of the trigger's cue
+	LAUNCHPAD_ACTION_COMMAND,
+
+	// Set the playback volume of the trigger's cue from a button pressure
+	LAUNCHPAD_ACTION_PRESSURE,
+} LaunchpadActionType;
+
+// Typedefs: The cue list commands of the global buttons (other than Stop All)
+typedef enum LaunchpadCueListCommand
+{
+	// Play the selected cue and select the next one
+	LAUNCHPAD_COMMAND_GO,
+
+	// Select the previous cue
+	LAUNCHPAD_COMMAND_UP,
+
+	// Select the next cue
+	LAUNCHPAD_COMMAND_DOWN,
+
+	// Select the previous cue, as Up
+	LAUNCHPAD_COMMAND_LEFT,
+
+	// Select the next cue, as Down
+	LAUNCHPAD_COMMAND_RIGHT,
+} LaunchpadCueListCommand;
+
+// Typedefs: An action for a trigger to be run on the UI thread
+typedef struct LaunchpadAction
+{
+	LaunchpadActionType type;
+
+	// The trigger to run the action for, or NULL if the trigger has been
+	// destroyed since the action was queued
+	StackLaunchpadTrigger *trigger;
+
+	// The action to run on the cue (for LAUNCHPAD_ACTION_TRIGGER)
+	StackTriggerAction action;
+
+	// The command to run (for LAUNCHPAD_ACTION_COMMAND)
+	LaunchpadCueListCommand command;
+
+	// The pressure of the button (for LAUNCHPAD_ACTION_TRIGGER and
+	// LAUNCHPAD_ACTION_PRESSURE)
+	uint8_t pressure;
+
+	// The time that the button event that caused the action was read
+	stack_time_t time;
+
+	// The time that the action was queued
+	stack_time_t queued_time;
+
+	// Whether the next action in the queue is from the same button press,
+	// in which case they're run together under one lock of the cue list
+	bool batch_continues;
+} LaunchpadAction;
+
+// Typedefs: A single-producer, single-consumer queue of actions. The MIDI
+// thread is the only producer, and the UI thread the only consumer
+typedef struct LaunchpadActionQueue
+{
+	LaunchpadAction actions[LAUNCHPAD_ACTION_QUEUE_SIZE];
 
-// Definitions - MIDI events:
-#define MIDI_NOTE_ON          0x90
-#define MIDI_CONTROL_CHANGE   0xb0
-#define MIDI_SYSEX            0xf0
-#define MIDI_SYSEX_END        0xf7
-
-// Definitions: Global button indices:
-#define GLOBAL_BUTTON_INDEX_UP       0
-#define GLOBAL_BUTTON_INDEX_DOWN     1
-#define GLOBAL_BUTTON_INDEX_LEFT     2
-#define GLOBAL_BUTTON_INDEX_RIGHT    3
-#define GLOBAL_BUTTON_INDEX_GO       4
-#define GLOBAL_BUTTON_INDEX_STOP_ALL 5
-#define GLOBAL_BUTTON_COUNT          6
-
-// Typedefs: Details of a button on the device
+	// The index of the next action to be written (only written by the
+	// producer) and the next to be read (only written by the consumer). These
+	// only ever increase, and wrap around the array
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+
+	// An eventfd that the UI thread watches to know that there are actions
+	int event_fd;
+
+	// Whether the producer is queueing a batch of actions, and how many it
+	// has written past the head so far. A batch is only made visible to the
+	// consumer once it is complete (only used by the producer)
+	bool batching;
+	size_t batch_count;
+
+	// The number of actions dropped because the queue was full
+	std::atomic<uint64_t> dropped;
+} LaunchpadActionQueue;
+
+// Typedefs: The state of a button on the device that the MIDI thread keeps.
+// How the button is lit is kept separately, in LaunchpadLeds
 typedef struct LaunchpadButton
 {
+	// When a press of the button last triggered its cues. Only used by the
+	// MIDI thread
 	stack_time_t last_press_time;
-	int32_t usage_count;
-	int8_t r;
-	int8_t g;
-	int8_t b;
+
+	// When the button next triggers its cues by itself (either for a press
+	// that was queued, or because it is being held), or zero if it won't.
+	// Only used by the MIDI thread
+	stack_time_t timer_time;
+
+	// Whether the button is currently held down, the latest pressure on it,
+	// and the velocity of the latest press. Only used by the MIDI thread
+	bool held;
+	uint8_t pressure;
+	uint8_t velocity;
+
+	// Whether the pressure has changed since it was last applied to the cues
+	bool pressure_pending;
+
+	// Whether the timer is for a queued press rather than a held repeat
+	bool queued;
 } LaunchpadButton;
 
+// Typedefs: Counters of the traffic to and from a device since it was first
+// found. These are updated by the MIDI and LED threads and read by the UI
+// without any locking
+typedef struct LaunchpadDeviceStats
+{
+	// The bytes and MIDI messages written to the device
+	std::atomic<uint64_t> bytes_sent;
+	std::atomic<uint64_t> messages_sent;
+
+	// The number of LED flushes that sent anything, the total and the longest
+	// time that writing and draining them took (in nanoseconds), and the LEDs
+	// that they sent
+	std::atomic<uint64_t> flushes;
+	std::atomic<uint64_t> flush_time;
+	std::atomic<uint64_t> flush_time_max;
+	std::atomic<uint64_t> leds_sent;
+
+	// The number of LED changes made whilst a flush of the device was already
+	// waiting, which were combined in to that flush
+	std::atomic<uint64_t> coalesced;
+
+	// The number of reads that filled our whole buffer (so more input was
+	// waiting), and of messages that were cut short
+	std::atomic<uint64_t> full_reads;
+	std::atomic<uint64_t> incomplete_messages;
+
+	// The number of times the device has been opened
+	std::atomic<uint64_t> opens;
+} LaunchpadDeviceStats;
+
+// Typedefs: The functions used to talk to the MIDI ports of a device. This is
+// normally ALSA, but can be swapped out (e.g. for an in-memory loopback, so
+// that we can be benchmarked without any hardware)
+struct LaunchpadDevice;
+typedef struct LaunchpadMidiBackend
+{
+	// Opens the ports at an address, setting the handles, poll descriptor and
+	// timestamped flag of the device. Returns false (leaving the handles NULL)
+	// if they couldn't be opened or are not the ports of the device
+	bool (*open)(struct LaunchpadDevice *device, const char *address);
+
+	// Reads from the input port of the device. If the backend knows when the
+	// data arrived it sets timestamp (on CLOCK_MONOTONIC), otherwise it is
+	// left alone
+	ssize_t (*read)(struct LaunchpadDevice *device, unsigned char *buffer, size_t size, struct timespec *timestamp);
+
+	// These behave the same as their snd_rawmidi_* equivalents
+	ssize_t (*write)(snd_rawmidi_t *handle, const void *buffer, size_t size);
+	int (*drain)(snd_rawmidi_t *handle);
+	int (*close)(snd_rawmidi_t *handle);
+} LaunchpadMidiBackend;
+
 // Typedefs: Details of the entire device
 typedef struct LaunchpadDevice
 {
+	// The ID of the device (its ALSA card ID), which triggers refer to it by
+	char id[32];
+
+	// The position of the device in the devices list, which identifies it in
+	// captures
+	uint8_t index;
+
 	LaunchpadButton *buttons;
 	snd_rawmidi_t *handle_in;
 	snd_rawmidi_t *handle_out;
 	struct pollfd poll_fds;
+	LaunchpadMidiParser parser;
+
+	// The ALSA address the device was last successfully opened at
+	char address[32];
+
+	// Whether ALSA timestamps the messages we read from the device
+	bool timestamped;
+
+	// The model of the device, which never changes once created
+	const LaunchpadProfile *profile;
+
 	uint8_t rows;
 	uint8_t columns;
-	bool ready;
+	std::atomic<bool> ready;
+
+	// How the LEDs are lit, and the number of them that have changed but not
+	// yet been sent to the device (guarded by led_mutex)
+	LaunchpadLeds leds;
+	size_t dirty_count;
+
+	// Lock held whilst flushing the LEDs, and whilst writing to (or closing)
+	// handle_out. If led_mutex is needed at the same time, this must be taken
+	// first
+	std::mutex output_mutex;
+
+	// When the earliest press that has changed a colour that has not yet been
+	// sent happened, or zero if there isn't one (guarded by led_mutex)
+	stack_time_t echo_time;
+
+	// The number of buttons with a pressure change that has not yet been
+	// applied, and when pressure changes were last applied. Only used by the
+	// MIDI thread
+	size_t pressure_pending_count;
+	stack_time_t last_pressure_time;
+
+	// The number of buttons with a timer set. Only used by the MIDI thread
+	size_t timer_count;
+
+	// The current dispatch table for the device. This is never NULL, and is
+	// only replaced whilst holding list_mutex
+	std::atomic<LaunchpadDispatchTable*> dispatch;
+
+	// How every button is lit when not pressed on each page, so that
+	// changing page doesn't have to look at any triggers (guarded by
+	// led_mutex)
+	LaunchpadFrameButton frames[LAUNCHPAD_MAX_PAGES][LAUNCHPAD_MAX_BUTTONS];
+
+	// The page currently shown (only changed whilst holding led_mutex), and
+	// the number of pages and the page buttons that the frames were built
+	// for (only changed whilst holding list_mutex and led_mutex)
+	std::atomic<uint8_t> page;
+	uint8_t page_count;
+	uint8_t page_buttons[LAUNCHPAD_MAX_PAGES];
+
+	// Counters for monitoring how well we're keeping up with the device
+	LaunchpadDeviceStats stats;
 } LaunchpadDevice;
 
-// Typedefs: Details of the global buttons
-typedef struct LaunchpadGlobalButton {
-	uint8_t column;
-	uint8_t row;
-	uint8_t r;
-	uint8_t g;
-	uint8_t b;
-	uint32_t keymap;
-} LaunchpadGlobalButton;
+// Typedefs: A Launchpad found whilst scanning the sound cards
+typedef struct LaunchpadDeviceAddress
+{
+	char id[32];
+	char address[32];
+	const LaunchpadProfile *profile;
+} LaunchpadDeviceAddress;
+
+// Typedefs: How the MIDI thread is scheduled. These are global settings, and
+// are applied by the thread itself when changed is set
+typedef struct LaunchpadThreadSettings
+{
+	// Whether to run with real-time (SCHED_FIFO) priority
+	std::atomic<bool> realtime;
+
+	// The CPU to pin the thread to, or -1 to run on any
+	std::atomic<int> cpu;
+
+	// Whether to lock the memory that the thread uses in to RAM
+	std::atomic<bool> lock_memory;
+
+	std::atomic<bool> changed;
+} LaunchpadThreadSettings;
+
+// Typedefs: How the MIDI thread is actually being scheduled, which may differ
+// from the settings if the system didn't allow them
+typedef struct LaunchpadThreadStatus
+{
+	std::atomic<bool> realtime;
+
+	// The CPU the thread is pinned to, or -1 if it runs on any
+	std::atomic<int> cpu;
+
+	std::atomic<bool> memory_locked;
+} LaunchpadThreadStatus;
+
+// Typedefs: The counters at the last refresh of the statistics in the global
+// settings dialog, which rates are worked out from
+typedef struct LaunchpadStatsSnapshot
+{
+	stack_time_t time;
+	size_t device_count;
+	uint64_t bytes_sent[LAUNCHPAD_MAX_DEVICES];
+	uint64_t messages_sent[LAUNCHPAD_MAX_DEVICES];
+	uint64_t flushes[LAUNCHPAD_MAX_DEVICES];
+} LaunchpadStatsSnapshot;
 
 // The list of active triggers for the thread
 std::list<StackLaunchpadTrigger*> trigger_list;
 
-// The mutex lock around our list (might not be necessary as everything happens
-// on the UI thread)
+// The number of triggers in trigger_list, which the thread can read without
+// taking the lock
+std::atomic<size_t> trigger_count(0);
+
+// The mutex lock around our list of triggers, and the building and
+// publishing of the dispatch tables and the button usage of the devices.
+//
+// Where more than one lock is needed at once they are always taken in this
+// order (skipping any that aren't needed): list_mutex, device_mutex, the
+// output_mutex of a device, then led_mutex. Nothing takes any other lock
+// whilst holding led_mutex (the LED thread lets go of it before flushing), and
+// capture_mutex is never held with any of them
 std::mutex list_mutex;
 
+// The triggers that show the state of their cue on their button, which the
+// feedback timer looks at, and the main loop source of that timer, or 0 if
+// there isn't one. The timer only runs whilst there are such triggers. Only
+// used by the UI thread
+std::vector<StackLaunchpadTrigger*> feedback_triggers;
+guint feedback_source = 0;
+
+// The main loop source that adds staged triggers to the dispatch tables once
+// a show has finished loading, or 0 if there isn't one (guarded by list_mutex)
+guint load_source = 0;
+
+// All the devices we've found, in the order we found them. Devices remain in
+// here when they're unplugged (with ready set to false) so that they keep
+// their state for when they come back. Only the MIDI thread adds to this
+// (guarded by device_mutex)
+std::vector<LaunchpadDevice*> devices;
+
+// The first device we found, which triggers without a device ID are bound to.
+// As devices are never removed, this never changes once it has been set
+std::atomic<LaunchpadDevice*> default_device(NULL);
+
+// The mutex lock around the list of devices. If this is needed at the same
+// time as list_mutex, list_mutex must be taken first
+std::mutex device_mutex;
+
+// Incremented by the MIDI thread immediately before and after it uses the
+// dispatch tables, so that it is odd whilst the thread may hold on to one.
+// Writers use this to know when an old table can no longer be in use
+std::atomic<uint64_t> dispatch_generation(0);
+
 // The single thread
 std::thread midi_thread;
 
 // Whether the thread is running
-bool thread_running = false;
+std::atomic<bool> thread_running(false);
+
+// An eventfd that is signalled to wake the thread up from poll() (e.g. when
+// the last trigger is destroyed or the device is closed)
+int wakeup_fd = -1;
+
+// How the MIDI thread is scheduled, and how it actually managed to be
+LaunchpadThreadSettings thread_settings = {{false}, {-1}, {false}, {false}};
+LaunchpadThreadStatus thread_status = {{false}, {-1}, {false}};
+
+// Whether the memory of the MIDI thread is currently locked. Only used by the
+// MIDI thread
+bool thread_memory_locked = false;
+
+// The latency of each stage of handling button presses
+LaunchpadLatencyHistogram latency_histograms[LAUNCHPAD_LATENCY_STAGE_COUNT];
+static const char *latency_stage_names[LAUNCHPAD_LATENCY_STAGE_COUNT] = {"Read", "Parse", "Dispatch", "Enqueue", "Execute", "LED echo", "Total"};
+
+// Whether we've been asked to capture MIDI, and the file to capture it to.
+// Only used by the UI thread
+bool capture_requested = false;
+std::string capture_filename;
+
+// Whether MIDI is currently being captured, and the clock time that the
+// capture started at
+std::atomic<bool> capture_enabled(false);
+stack_time_t capture_start_time = 0;
+
+// The queue of records waiting to be written to the capture file, and whether
+// it has been set up yet (which is only done once)
+LaunchpadCaptureQueue capture_queue;
+bool capture_queue_ready = false;
+
+// The thread that writes to the capture file, and the lock and condition
+// used to stop it
+std::thread capture_thread;
+std::mutex capture_mutex;
+std::condition_variable capture_condition;
+bool capture_thread_running = false;
+
+// The thread that sends LED changes to the devices
+std::thread led_thread;
+
+// Whether the LED thread is running (only changed whilst holding led_mutex)
+std::atomic<bool> led_thread_running(false);
+
+// The queue of actions from the MIDI thread to the UI thread
+LaunchpadActionQueue action_queue = {{}, {0}, {0}, -1, false, 0, {0}};
+
+// Whether actions are scheduled from the time of the button press rather than
+// run as soon as the UI thread gets to them, and the fixed latency that they
+// are run with. Scheduled cues are started as though they started exactly at
+// that time. Only used by the UI thread
+bool schedule_actions = false;
+uint32_t start_offset_ms = 0;
+
+// The main loop source that runs scheduled actions once they're due, or 0 if
+// there isn't one. Only used by the UI thread
+guint action_timer_source = 0;
+
+// The devices that have changes for the LED thread to send (guarded by
+// led_mutex)
+std::vector<LaunchpadDevice*> led_dirty_devices;
+
+// The mutex lock around the button colours and dirty flags of the devices,
+// and the condition the LED thread waits on for changes. This is the last lock
+// in the order given at list_mutex
+std::mutex led_mutex;
+std::condition_variable led_condition;
 
 // Details of all the global buttons
 LaunchpadGlobalButton global_buttons[GLOBAL_BUTTON_COUNT] = {
-	{1, 1, 255, 255, 255, GDK_KEY_Up},
-	{2, 1, 255, 255, 255, GDK_KEY_Down},
-	{3, 1, 255, 255, 255, GDK_KEY_Left},
-	{4, 1, 255, 255, 255, GDK_KEY_Right},
-	{9, 9,   0, 255, 0,   GDK_KEY_space},
-	{9, 6, 255,   0, 0,   GDK_KEY_Escape}
+	{1, 1, 255, 255, 255},
+	{2, 1, 255, 255, 255},
+	{3, 1, 255, 255, 255},
+	{4, 1, 255, 255, 255},
+	{9, 9,   0, 255, 0},
+	{9, 6, 255,   0, 0}
+};
+
+// The command run by each global button, indexed as global_buttons. Stop All
+// isn't a command, and is queued as its own action
+static const LaunchpadCueListCommand global_button_commands[GLOBAL_BUTTON_COUNT] = {
+	LAUNCHPAD_COMMAND_UP,
+	LAUNCHPAD_COMMAND_DOWN,
+	LAUNCHPAD_COMMAND_LEFT,
+	LAUNCHPAD_COMMAND_RIGHT,
+	LAUNCHPAD_COMMAND_GO,
+	LAUNCHPAD_COMMAND_GO
 };
 
 ////////////////////////////////////////////////////////////////////////////////
-// THREAD FUNCTIONS
+// TRIGGER INDEX
 
-static bool stack_launchpad_trigger_get_device_address(char *device_address, size_t device_address_length)
+// Returns true if the trigger is bound to the given device. Triggers without a
+// device ID are bound to the first device that we found
+static bool stack_launchpad_trigger_is_bound(StackLaunchpadTrigger *trigger, LaunchpadDevice *device)
 {
-	int err;
-	bool found = false;
-	int card = -1;
+	if (trigger->device_id == NULL || trigger->device_id[0] == '\0')
+	{
+		return device == default_device.load();
+	}
 
-	// Iterate over all sound cards
-	while (snd_card_next(&card) >= 0 && card != -1)
+	return strcmp(trigger->device_id, device->id) == 0;
+}
+
+// Returns the device that the trigger is bound to, or NULL if we've not found
+// that device
+static LaunchpadDevice *stack_launchpad_trigger_get_trigger_device(StackLaunchpadTrigger *trigger)
+{
+	std::lock_guard<std::mutex> lock(device_mutex);
+	for (auto device : devices)
 	{
-		snd_ctl_t *ctl;
-		char card_device[32];
-		snprintf(card_device, sizeof(card_device), "hw:%d", card);
-		err = snd_ctl_open(&ctl, card_device, 0);
-		if (err < 0)
+		if (stack_launchpad_trigger_is_bound(trigger, device))
 		{
-			break;
+			return device;
 		}
+	}
+
+	return NULL;
+}
+
+// Builds a new dispatch table for a device from the trigger list, leaving out
+// the given trigger (if not NULL) and any staged triggers. The caller should
+// hold list_mutex
+static LaunchpadDispatchTable *stack_launchpad_trigger_build_dispatch(LaunchpadDevice *device, StackLaunchpadTrigger *exclude)
+{
+	LaunchpadDispatchTable *table = new LaunchpadDispatchTable();
 
-		while (!found)
+	// There are as many pages as the highest page that any trigger is on
+	size_t page_count = 1;
+	for (auto trigger : trigger_list)
+	{
+		if (trigger != exclude && !trigger->staged && stack_launchpad_trigger_is_bound(trigger, device) && trigger->page > page_count && trigger->page <= LAUNCHPAD_MAX_PAGES)
 		{
-			int dev;
+			page_count = trigger->page;
+		}
+	}
+	table->pages.resize(page_count);
 
-			// Get the next device
-			if ((err = snd_ctl_rawmidi_next_device(ctl, &dev)) < 0)
-			{
-				break;
-			}
+	for (auto trigger : trigger_list)
+	{
+		if (trigger == exclude || trigger->staged || !stack_launchpad_trigger_is_bound(trigger, device))
+		{
+			continue;
+		}
 
-			// If we've reached the last device, break out of the loop
-			if (dev < 0)
+		int index = stack_launchpad_trigger_button_index(trigger->column, trigger->row);
+		if (index >= 0 && trigger->page >= 1 && trigger->page <= page_count)
+		{
+			LaunchpadPage *page = &table->pages[trigger->page - 1];
+			page->button_triggers[index].push_back(trigger);
+
+			// Triggers sharing a button use the longest interval of any of
+			// them, and queue or repeat if any of them ask to
+			LaunchpadButtonPolicy *policy = &page->button_policies[index];
+			const stack_time_t interval = (stack_time_t)trigger->debounce_ms * NANOSECS_PER_MILLISEC;
+			if (interval > policy->interval)
 			{
-				break;
+				policy->interval = interval;
 			}
+			policy->queue = policy->queue || trigger->repeat_mode == LAUNCHPAD_REPEAT_QUEUE;
+			policy->hold = policy->hold || trigger->hold_repeat;
+		}
 
-			// Allocate the info structure
-			snd_rawmidi_info_t *info;
-			snd_rawmidi_info_malloc(&info);
+		if (trigger->use_for_cue_list)
+		{
+			table->cue_list_triggers.push_back(trigger);
+		}
+	}
+	memcpy(table->global_buttons, global_buttons, sizeof(LaunchpadGlobalButton) * GLOBAL_BUTTON_COUNT);
+	stack_launchpad_trigger_place_page_buttons(table);
 
-			// Get information about the device
-			snd_rawmidi_info_set_device(info, dev);
-			snd_rawmidi_info_set_subdevice(info, 0);
-			snd_rawmidi_info_set_stream(info, SND_RAWMIDI_STREAM_INPUT);
-			if ((err = snd_ctl_rawmidi_info(ctl, info)) < 0)
+	return table;
+}
+
+// Waits until the MIDI thread is no longer using any dispatch table that it
+// could have picked up before now. This must not be called by the MIDI thread
+// whilst it is using a dispatch table
+static void stack_launchpad_trigger_synchronize()
+{
+	uint64_t generation = dispatch_generation.load();
+	if (generation & 1)
+	{
+		// Dispatching is quick and never blocks, so we don't wait for long
+		while (dispatch_generation.load() == generation)
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+// Replaces the dispatch table of a device, freeing the old one once the MIDI
+// thread can no longer be using it. The caller should hold list_mutex
+static void stack_launchpad_trigger_publish_dispatch(LaunchpadDevice *device, LaunchpadDispatchTable *table)
+{
+	LaunchpadDispatchTable *old_table = device->dispatch.exchange(table);
+	stack_launchpad_trigger_synchronize();
+	delete old_table;
+}
+
+// Adds a trigger to the dispatch table of the device it is bound to (if we've
+// found that device) based on its current settings, taking it out of staging
+// if need be. The caller should hold list_mutex
+static void stack_launchpad_trigger_index_add(StackLaunchpadTrigger *trigger)
+{
+	trigger->staged = false;
+	LaunchpadDevice *device = stack_launchpad_trigger_get_trigger_device(trigger);
+	if (device != NULL)
+	{
+		stack_launchpad_trigger_publish_dispatch(device, stack_launchpad_trigger_build_dispatch(device, NULL));
+	}
+}
+
+// Removes a trigger from the dispatch table of its device. This must be
+// called before the device, page, column, row, cue list or action settings of the
+// trigger are changed, and the caller should hold list_mutex until the
+// trigger has been added back. Once this returns, the MIDI thread is no longer
+// able to see the trigger
+static void stack_launchpad_trigger_index_remove(StackLaunchpadTrigger *trigger)
+{
+	// Staged triggers aren't in any dispatch table to begin with
+	if (trigger->staged)
+	{
+		return;
+	}
+
+	LaunchpadDevice *device = stack_launchpad_trigger_get_trigger_device(trigger);
+	if (device != NULL)
+	{
+		stack_launchpad_trigger_publish_dispatch(device, stack_launchpad_trigger_build_dispatch(device, trigger));
+	}
+}
+
+// Returns the page of a dispatch table that a device is showing
+static const LaunchpadPage *stack_launchpad_trigger_get_shown_page(LaunchpadDevice *device, const LaunchpadDispatchTable *table)
+{
+	return stack_launchpad_trigger_get_page(table, device->page.load());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// LATENCY
+
+// Returns the histogram bucket for a measurement in microseconds
+static size_t stack_launchpad_trigger_latency_bucket(uint64_t us)
+{
+	const uint64_t sub_buckets = 1 << LAUNCHPAD_LATENCY_SUB_BUCKET_BITS;
+	if (us < sub_buckets)
+	{
+		return us;
+	}
+	if (us >= ((uint64_t)2 << LAUNCHPAD_LATENCY_MAX_POWER))
+	{
+		return LAUNCHPAD_LATENCY_BUCKETS - 1;
+	}
+
+	// The power of two, and then the position within that power
+	const int power = 63 - __builtin_clzll(us);
+	const uint64_t position = (us >> (power - LAUNCHPAD_LATENCY_SUB_BUCKET_BITS)) - sub_buckets;
+	return ((power - LAUNCHPAD_LATENCY_SUB_BUCKET_BITS + 1) << LAUNCHPAD_LATENCY_SUB_BUCKET_BITS) + position;
+}
+
+// Returns the largest measurement in microseconds that goes in a bucket
+static uint64_t stack_launchpad_trigger_latency_bucket_limit(size_t bucket)
+{
+	const uint64_t sub_buckets = 1 << LAUNCHPAD_LATENCY_SUB_BUCKET_BITS;
+	if (bucket < sub_buckets)
+	{
+		return bucket;
+	}
+
+	const int power = (bucket >> LAUNCHPAD_LATENCY_SUB_BUCKET_BITS) + LAUNCHPAD_LATENCY_SUB_BUCKET_BITS - 1;
+	const uint64_t position = (bucket & (sub_buckets - 1)) + sub_buckets;
+	return ((position + 1) << (power - LAUNCHPAD_LATENCY_SUB_BUCKET_BITS)) - 1;
+}
+
+// Records how long (in nanoseconds) a stage took. This never blocks, so can be
+// called from any thread
+static void stack_launchpad_trigger_record_latency(LaunchpadLatencyStage stage, stack_time_t duration)
+{
+	LaunchpadLatencyHistogram *histogram = &latency_histograms[stage];
+	const uint64_t us = duration > 0 ? (uint64_t)duration / 1000 : 0;
+	histogram->counts[stack_launchpad_trigger_latency_bucket(us)].fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t max = histogram->max.load(std::memory_order_relaxed);
+	while (us > max && !histogram->max.compare_exchange_weak(max, us, std::memory_order_relaxed));
+}
+
+// Clears all the latency histograms. Measurements being recorded at the same
+// time may or may not be kept
+static void stack_launchpad_trigger_reset_latency()
+{
+	for (auto &histogram : latency_histograms)
+	{
+		for (auto &count : histogram.counts)
+		{
+			count.store(0, std::memory_order_relaxed);
+		}
+		histogram.max.store(0, std::memory_order_relaxed);
+	}
+}
+
+// Writes the sample count and percentiles of every stage in to buffer, one
+// line per stage. Percentiles are the upper limit of the bucket they fall in
+static void stack_launchpad_trigger_latency_report(char *buffer, size_t buffer_size)
+{
+	static const double percentiles[] = {0.5, 0.9, 0.99};
+	size_t offset = 0;
+	buffer[0] = '\0';
+
+	for (size_t stage = 0; stage < LAUNCHPAD_LATENCY_STAGE_COUNT && offset < buffer_size; stage++)
+	{
+		// Take a copy, as the counts can change whilst we look at them
+		const LaunchpadLatencyHistogram *histogram = &latency_histograms[stage];
+		uint32_t counts[LAUNCHPAD_LATENCY_BUCKETS];
+		uint64_t total = 0;
+		for (size_t i = 0; i < LAUNCHPAD_LATENCY_BUCKETS; i++)
+		{
+			counts[i] = histogram->counts[i].load(std::memory_order_relaxed);
+			total += counts[i];
+		}
+
+		if (total == 0)
+		{
+			offset += snprintf(&buffer[offset], buffer_size - offset, "%s: no samples\n", latency_stage_names[stage]);
+			continue;
+		}
+
+		uint64_t values[sizeof(percentiles) / sizeof(percentiles[0])];
+		for (size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++)
+		{
+			const uint64_t target = (uint64_t)ceil(percentiles[p] * total);
+			uint64_t seen = 0;
+			for (size_t i = 0; i < LAUNCHPAD_LATENCY_BUCKETS; i++)
 			{
-				snd_rawmidi_info_free(info);
-				if (err != -ENOENT)
+				seen += counts[i];
+				if (seen >= target)
 				{
+					values[p] = stack_launchpad_trigger_latency_bucket_limit(i);
 					break;
 				}
-				continue;
 			}
+		}
 
-			const char *stream_id = snd_rawmidi_info_get_id(info);
-			const char *name = snd_rawmidi_info_get_name(info);
+		offset += snprintf(&buffer[offset], buffer_size - offset, "%s: %llu samples, 50%% %llu us, 90%% %llu us, 99%% %llu us, max %llu us\n",
+			latency_stage_names[stage], (unsigned long long)total, (unsigned long long)values[0], (unsigned long long)values[1],
+			(unsigned long long)values[2], (unsigned long long)histogram->max.load(std::memory_order_relaxed));
+	}
+}
 
-			// Skip past non-Launchpad devices
-			if (strstr(name, "Launchpad") != NULL)
-			{
-				int subdevices_count = snd_rawmidi_info_get_subdevices_count(info);
+// Writes the latency percentiles of every stage to the log
+static void stack_launchpad_trigger_log_latency()
+{
+	char report[LAUNCHPAD_LATENCY_REPORT_SIZE];
+	stack_launchpad_trigger_latency_report(report, sizeof(report));
+	stack_log("stack_launchpad_trigger_log_latency(): Press-to-action latency:\n%s", report);
+}
 
-				for (int subdev = 0; subdev < subdevices_count; subdev++)
-				{
-					snd_rawmidi_info_set_subdevice(info, subdev);
-					if ((err = snd_ctl_rawmidi_info(ctl, info)) < 0)
-					{
-						break;
-					}
-					const char *subdevice_name = snd_rawmidi_info_get_subdevice_name(info);
+////////////////////////////////////////////////////////////////////////////////
+// STATISTICS
 
-					// Skip past non-Launchpad and non-MIDI (i.e. DAW) devices
-					if (strstr(subdevice_name, "Launchpad") != NULL && strstr(subdevice_name, " MIDI ") != NULL)
-					{
-						stack_log("stack_launchpad_trigger_get_device_address(): Launchpad found at hw:%d,%d,%d\n", card, dev, subdev);
-						snprintf(device_address, device_address_length, "hw:%d,%d,%d", card, dev, subdev);
-						found = true;
-						break;
-					}
-				}
-			}
+// Writes how the MIDI thread and actions are being scheduled, and the
+// counters of every device, in to buffer. Rates are since the given snapshot,
+// which is then updated. Only the device list is locked (and only briefly),
+// so this never waits for the MIDI or LED threads
+static void stack_launchpad_trigger_stats_report(char *buffer, size_t buffer_size, LaunchpadStatsSnapshot *snapshot)
+{
+	size_t offset = 0;
+	buffer[0] = '\0';
 
-			snd_rawmidi_info_free(info);
+	// Scheduling
+	const int cpu = thread_status.cpu;
+	char cpu_text[32] = "any CPU";
+	if (cpu >= 0)
+	{
+		snprintf(cpu_text, sizeof(cpu_text), "CPU %d", cpu);
+	}
+	offset += snprintf(&buffer[offset], buffer_size - offset, "MIDI thread: %s priority, %s, memory %s\n",
+		thread_status.realtime ? "real-time" : "normal", cpu_text, thread_status.memory_locked ? "locked" : "not locked");
+	if (offset < buffer_size)
+	{
+		if (schedule_actions)
+		{
+			offset += snprintf(&buffer[offset], buffer_size - offset, "Cues: start %u ms after the press", start_offset_ms);
+		}
+		else
+		{
+			offset += snprintf(&buffer[offset], buffer_size - offset, "Cues: start when the action runs");
 		}
+	}
+	if (offset < buffer_size)
+	{
+		const size_t depth = action_queue.head.load(std::memory_order_acquire) - action_queue.tail.load(std::memory_order_acquire);
+		offset += snprintf(&buffer[offset], buffer_size - offset, ", %zu/%d actions waiting, %llu dropped\n",
+			depth, LAUNCHPAD_ACTION_QUEUE_SIZE, (unsigned long long)action_queue.dropped.load(std::memory_order_relaxed));
+	}
 
-		// Tidy up
-		snd_ctl_close(ctl);
+	// Take a copy of the device list, as the devices themselves are never
+	// freed
+	LaunchpadDevice *report_devices[LAUNCHPAD_MAX_DEVICES];
+	size_t device_count = 0;
+	device_mutex.lock();
+	for (auto device : devices)
+	{
+		report_devices[device_count++] = device;
+	}
+	device_mutex.unlock();
+
+	const stack_time_t now = stack_get_clock_time();
+	const double seconds = snapshot->time != 0 && now > snapshot->time ? (double)(now - snapshot->time) / NANOSECS_PER_SEC : 0.0;
+	if (device_count == 0 && offset < buffer_size)
+	{
+		offset += snprintf(&buffer[offset], buffer_size - offset, "No devices found\n");
+	}
+	for (size_t i = 0; i < device_count && offset < buffer_size; i++)
+	{
+		const LaunchpadDevice *device = report_devices[i];
+		const LaunchpadDeviceStats *stats = &device->stats;
+		const uint64_t bytes_sent = stats->bytes_sent.load(std::memory_order_relaxed);
+		const uint64_t messages_sent = stats->messages_sent.load(std::memory_order_relaxed);
+		const uint64_t flushes = stats->flushes.load(std::memory_order_relaxed);
+		const uint64_t flush_time = stats->flush_time.load(std::memory_order_relaxed);
+		const uint64_t opens = stats->opens.load(std::memory_order_relaxed);
+
+		// Devices that we've not seen before have no rate yet
+		double bytes_rate = 0.0, messages_rate = 0.0, flushes_rate = 0.0;
+		if (seconds > 0.0 && i < snapshot->device_count)
+		{
+			bytes_rate = (bytes_sent - snapshot->bytes_sent[i]) / seconds;
+			messages_rate = (messages_sent - snapshot->messages_sent[i]) / seconds;
+			flushes_rate = (flushes - snapshot->flushes[i]) / seconds;
+		}
+		snapshot->bytes_sent[i] = bytes_sent;
+		snapshot->messages_sent[i] = messages_sent;
+		snapshot->flushes[i] = flushes;
+
+		offset += snprintf(&buffer[offset], buffer_size - offset, "%s (%s): %s, %.0f B/s, %.0f msg/s, %.1f flushes/s\n",
+			device->id, device->profile->name, device->ready ? "ready" : "not connected", bytes_rate, messages_rate, flushes_rate);
+		if (offset >= buffer_size)
+		{
+			break;
+		}
+		offset += snprintf(&buffer[offset], buffer_size - offset, "  Flush avg %llu us, max %llu us; %llu LEDs sent, %llu coalesced\n",
+			(unsigned long long)(flushes > 0 ? flush_time / flushes / 1000 : 0), (unsigned long long)(stats->flush_time_max.load(std::memory_order_relaxed) / 1000),
+			(unsigned long long)stats->leds_sent.load(std::memory_order_relaxed), (unsigned long long)stats->coalesced.load(std::memory_order_relaxed));
+		if (offset >= buffer_size)
+		{
+			break;
+		}
+		offset += snprintf(&buffer[offset], buffer_size - offset, "  %llu full reads, %llu incomplete messages, %llu reconnects\n",
+			(unsigned long long)stats->full_reads.load(std::memory_order_relaxed), (unsigned long long)stats->incomplete_messages.load(std::memory_order_relaxed),
+			(unsigned long long)(opens > 0 ? opens - 1 : 0));
+	}
+
+	snapshot->time = now;
+	snapshot->device_count = device_count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CAPTURE
+
+// Adds records to the capture queue for data read from or written to a device
+// (or for the device being opened or closed) at the given time, or now if the
+// time is zero. This never blocks, so can be called from any thread. If the
+// queue is full the records are dropped
+static void stack_launchpad_trigger_capture(LaunchpadDevice *device, LaunchpadCaptureType type, const unsigned char *data, size_t length, stack_time_t time)
+{
+	if (!capture_enabled.load(std::memory_order_acquire))
+	{
+		return;
+	}
+
+	const int64_t capture_time = (time != 0 ? time : stack_get_clock_time()) - capture_start_time;
+	size_t offset = 0;
+	do
+	{
+		// Claim the next slot, if it's free
+		size_t position = capture_queue.head.load(std::memory_order_relaxed);
+		LaunchpadCaptureSlot *slot;
+		while (true)
+		{
+			slot = &capture_queue.slots[position & (LAUNCHPAD_CAPTURE_QUEUE_SIZE - 1)];
+			const intptr_t difference = (intptr_t)slot->sequence.load(std::memory_order_acquire) - (intptr_t)position;
+			if (difference == 0)
+			{
+				if (capture_queue.head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				capture_queue.dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else
+			{
+				position = capture_queue.head.load(std::memory_order_relaxed);
+			}
+		}
+
+		const size_t record_length = length - offset < LAUNCHPAD_CAPTURE_DATA_SIZE ? length - offset : LAUNCHPAD_CAPTURE_DATA_SIZE;
+		LaunchpadCaptureRecord *record = &slot->record;
+		record->time = capture_time;
+		record->device = device->index;
+		record->type = type;
+		record->length = record_length;
+		record->reserved = 0;
+		if (record_length > 0)
+		{
+			memcpy(record->data, &data[offset], record_length);
+		}
+		offset += record_length;
+
+		// Let the capture thread have it
+		slot->sequence.store(position + 1, std::memory_order_release);
+	} while (offset < length);
+}
+
+// Takes the oldest record from the capture queue. Returns false if the queue
+// is empty. This is only called by the capture thread (or whilst it isn't
+// running)
+static bool stack_launchpad_trigger_capture_pop(LaunchpadCaptureRecord *record)
+{
+	LaunchpadCaptureSlot *slot = &capture_queue.slots[capture_queue.tail & (LAUNCHPAD_CAPTURE_QUEUE_SIZE - 1)];
+	if (slot->sequence.load(std::memory_order_acquire) != capture_queue.tail + 1)
+	{
+		return false;
+	}
+
+	*record = slot->record;
+	slot->sequence.store(capture_queue.tail + LAUNCHPAD_CAPTURE_QUEUE_SIZE, std::memory_order_release);
+	capture_queue.tail++;
+	return true;
+}
+
+// Writes everything in the capture queue to the capture file, wrapping around
+// to the start of the records once the file is full. Returns false if
+// writing failed
+static bool stack_launchpad_trigger_capture_write(int fd, LaunchpadCaptureHeader *header)
+{
+	LaunchpadCaptureRecord records[64];
+	size_t count = 0;
+	do
+	{
+		count = 0;
+		while (count < 64 && stack_launchpad_trigger_capture_pop(&records[count]))
+		{
+			count++;
+		}
+
+		for (size_t done = 0; done < count; )
+		{
+			const uint64_t index = header->written % header->capacity;
+			const size_t batch = count - done < header->capacity - index ? count - done : header->capacity - index;
+			const off_t offset = sizeof(LaunchpadCaptureHeader) + index * sizeof(LaunchpadCaptureRecord);
+			if (pwrite(fd, &records[done], batch * sizeof(LaunchpadCaptureRecord), offset) != (ssize_t)(batch * sizeof(LaunchpadCaptureRecord)))
+			{
+				return false;
+			}
+			header->written += batch;
+			done += batch;
+		}
+	} while (count == 64);
+
+	// Keep the header up to date, so that the file can be read at any time
+	return pwrite(fd, header, sizeof(LaunchpadCaptureHeader), 0) == sizeof(LaunchpadCaptureHeader);
+}
+
+// Thread that writes the capture queue to the capture file (which it owns)
+// until it is told to stop
+static void stack_launchpad_trigger_capture_thread(int fd)
+{
+	LaunchpadCaptureHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LAUNCHPAD_CAPTURE_MAGIC, sizeof(LAUNCHPAD_CAPTURE_MAGIC));
+	header.version = LAUNCHPAD_CAPTURE_VERSION;
+	header.record_size = sizeof(LaunchpadCaptureRecord);
+	header.capacity = LAUNCHPAD_CAPTURE_FILE_RECORDS;
+	header.written = 0;
+
+	bool failed = false;
+	uint64_t dropped = 0;
+	std::unique_lock<std::mutex> lock(capture_mutex);
+	while (true)
+	{
+		capture_condition.wait_for(lock, std::chrono::milliseconds(LAUNCHPAD_CAPTURE_INTERVAL_MS), []() { return !capture_thread_running; });
+		const bool running = capture_thread_running;
+		lock.unlock();
+
+		// Only complain about failure once
+		if (!stack_launchpad_trigger_capture_write(fd, &header) && !failed)
+		{
+			stack_log("stack_launchpad_trigger_capture_thread(): Failed to write to capture file: %d\n", errno);
+			failed = true;
+		}
+
+		const uint64_t new_dropped = capture_queue.dropped.load(std::memory_order_relaxed);
+		if (new_dropped != dropped)
+		{
+			stack_log("stack_launchpad_trigger_capture_thread(): Capture queue full, dropped %llu records\n", (unsigned long long)(new_dropped - dropped));
+			dropped = new_dropped;
+		}
+
+		lock.lock();
+		if (!running)
+		{
+			break;
+		}
+	}
+
+	close(fd);
+}
+
+// Starts capturing to capture_filename. This is called from the UI thread
+static void stack_launchpad_trigger_start_capture()
+{
+	int fd = open(capture_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		stack_log("stack_launchpad_trigger_start_capture(): Failed to open %s: %d\n", capture_filename.c_str(), errno);
+		return;
+	}
+
+	// Set the queue up the first time around, and otherwise throw away
+	// anything that was queued after the last capture stopped
+	if (!capture_queue_ready)
+	{
+		for (size_t i = 0; i < LAUNCHPAD_CAPTURE_QUEUE_SIZE; i++)
+		{
+			capture_queue.slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		capture_queue.head = 0;
+		capture_queue.tail = 0;
+		capture_queue_ready = true;
+	}
+	else
+	{
+		LaunchpadCaptureRecord record;
+		while (stack_launchpad_trigger_capture_pop(&record));
+	}
+	capture_queue.dropped = 0;
+
+	capture_thread_running = true;
+	capture_thread = std::thread(stack_launchpad_trigger_capture_thread, fd);
+	capture_start_time = stack_get_clock_time();
+	capture_enabled.store(true, std::memory_order_release);
+	stack_log("stack_launchpad_trigger_start_capture(): Capturing MIDI to %s\n", capture_filename.c_str());
+}
+
+// Stops capturing (if we are), once everything queued has been written. This
+// is called from the UI thread
+static void stack_launchpad_trigger_stop_capture()
+{
+	if (!capture_thread.joinable())
+	{
+		return;
+	}
+
+	capture_enabled = false;
+	capture_mutex.lock();
+	capture_thread_running = false;
+	capture_mutex.unlock();
+	capture_condition.notify_one();
+	capture_thread.join();
+	stack_log("stack_launchpad_trigger_stop_capture(): Stopped capturing MIDI\n");
+}
+
+// Sets whether we capture MIDI, and the file we capture it to. Capturing only
+// happens whilst the MIDI thread is running. This is called from the UI thread
+static void stack_launchpad_trigger_set_capture(bool enabled, const char *filename)
+{
+	if (enabled == capture_requested && capture_filename == filename)
+	{
+		return;
+	}
+
+	stack_launchpad_trigger_stop_capture();
+	capture_requested = enabled;
+	capture_filename = filename;
+	if (capture_requested && capture_filename.size() > 0 && thread_running)
+	{
+		stack_launchpad_trigger_start_capture();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ALSA BACKEND
+
+// Gets the ID of a sound card into the given buffer
+static bool stack_launchpad_trigger_get_card_id(snd_ctl_t *ctl, char *card_id, size_t card_id_length)
+{
+	snd_ctl_card_info_t *card_info;
+	snd_ctl_card_info_malloc(&card_info);
+	bool result = snd_ctl_card_info(ctl, card_info) >= 0;
+	if (result)
+	{
+		snprintf(card_id, card_id_length, "%s", snd_ctl_card_info_get_id(card_info));
+	}
+	snd_ctl_card_info_free(card_info);
+
+	return result;
+}
+
+// Attempts to open the Launchpad at the given ALSA address. Returns true if
+// the device was opened and is the Launchpad with the ID of the device
+static bool stack_launchpad_trigger_alsa_open(LaunchpadDevice *device, const char *device_address)
+{
+	int result = snd_rawmidi_open(&device->handle_in, &device->handle_out, device_address, 0);
+	if (result < 0)
+	{
+		device->handle_in = NULL;
+		device->handle_out = NULL;
+		return false;
+	}
+
+	// Card numbers can change across a replug, so make sure that what's at
+	// this address is still the same Launchpad
+	bool is_device = false;
+	snd_rawmidi_info_t *info;
+	snd_rawmidi_info_malloc(&info);
+	if (snd_rawmidi_info(device->handle_in, info) >= 0)
+	{
+		const char *subdevice_name = snd_rawmidi_info_get_subdevice_name(info);
+		if (strstr(subdevice_name, "Launchpad") != NULL && strstr(subdevice_name, " MIDI ") != NULL)
+		{
+			snd_ctl_t *ctl;
+			char card_device[32], card_id[32];
+			snprintf(card_device, sizeof(card_device), "hw:%d", snd_rawmidi_info_get_card(info));
+			if (snd_ctl_open(&ctl, card_device, 0) >= 0)
+			{
+				is_device = stack_launchpad_trigger_get_card_id(ctl, card_id, sizeof(card_id)) && strcmp(card_id, device->id) == 0;
+				snd_ctl_close(ctl);
+			}
+		}
+	}
+	snd_rawmidi_info_free(info);
+
+	int count = is_device ? snd_rawmidi_poll_descriptors(device->handle_in, &device->poll_fds, 1) : 0;
+	if (count == 0)
+	{
+		if (is_device)
+		{
+			stack_log("stack_launchpad_trigger_alsa_open(): Failed to get MIDI poll descriptors\n");
+		}
+		snd_rawmidi_close(device->handle_in);
+		snd_rawmidi_close(device->handle_out);
+		device->handle_in = NULL;
+		device->handle_out = NULL;
+		return false;
+	}
+
+	// Remember where we found it
+	if (device_address != device->address)
+	{
+		snprintf(device->address, sizeof(device->address), "%s", device_address);
+	}
+
+	// Ask ALSA to timestamp the messages as they arrive from the device, so
+	// that we can tell how long they waited before we read them. Older
+	// versions of ALSA can't do this, so we just don't measure it
+	device->timestamped = false;
+#if SND_LIB_VERSION >= 0x010206
+	snd_rawmidi_params_t *params;
+	snd_rawmidi_params_malloc(&params);
+	if (snd_rawmidi_params_current(device->handle_in, params) >= 0
+		&& snd_rawmidi_params_set_read_mode(device->handle_in, params, SND_RAWMIDI_READ_TSTAMP) >= 0
+		&& snd_rawmidi_params_set_clock_type(device->handle_in, params, SND_RAWMIDI_CLOCK_MONOTONIC) >= 0
+		&& snd_rawmidi_params(device->handle_in, params) >= 0)
+	{
+		device->timestamped = true;
+	}
+	snd_rawmidi_params_free(params);
+#endif
+
+	return true;
+}
+
+// Reads from the input port of a device, using the timestamp that ALSA gave
+// the data if it has one
+static ssize_t stack_launchpad_trigger_alsa_read(LaunchpadDevice *device, unsigned char *buffer, size_t size, struct timespec *timestamp)
+{
+#if SND_LIB_VERSION >= 0x010206
+	if (device->timestamped)
+	{
+		// Everything in a timestamped read came in at the same time
+		return snd_rawmidi_tread(device->handle_in, timestamp, buffer, size);
+	}
+#endif
+
+	return snd_rawmidi_read(device->handle_in, buffer, size);
+}
+
+// The backend used for real devices
+static const LaunchpadMidiBackend launchpad_alsa_backend = {
+	stack_launchpad_trigger_alsa_open,
+	stack_launchpad_trigger_alsa_read,
+	snd_rawmidi_write,
+	snd_rawmidi_drain,
+	snd_rawmidi_close,
+};
+
+// The backend we talk to devices through
+const LaunchpadMidiBackend *midi_backend = &launchpad_alsa_backend;
+
+////////////////////////////////////////////////////////////////////////////////
+// THREAD FUNCTIONS
+
+// Wakes the thread up so that it re-checks the trigger list and device state
+static void stack_launchpad_trigger_wake_thread()
+{
+	if (wakeup_fd >= 0)
+	{
+		uint64_t value = 1;
+		if (write(wakeup_fd, &value, sizeof(value)) < 0)
+		{
+			stack_log("stack_launchpad_trigger_wake_thread(): Failed to signal thread: %d\n", errno);
+		}
+	}
+}
+
+// Clears any pending wake up of the thread
+static void stack_launchpad_trigger_clear_wakeup()
+{
+	uint64_t value;
+	if (read(wakeup_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	{
+		stack_log("stack_launchpad_trigger_clear_wakeup(): Failed to read wakeup: %d\n", errno);
+	}
+}
+
+// Scans all the sound cards for Launchpads, filling in found with the ID,
+// address and model of up to max_found of them. Returns the number of
+// Launchpads found
+static size_t stack_launchpad_trigger_find_devices(LaunchpadDeviceAddress *found, size_t max_found)
+{
+	int err;
+	size_t found_count = 0;
+	int card = -1;
+
+	// Iterate over all sound cards
+	while (found_count < max_found && snd_card_next(&card) >= 0 && card != -1)
+	{
+		snd_ctl_t *ctl;
+		char card_device[32];
+		snprintf(card_device, sizeof(card_device), "hw:%d", card);
+		err = snd_ctl_open(&ctl, card_device, 0);
+		if (err < 0)
+		{
+			continue;
+		}
+
+		// We use the first Launchpad MIDI port on each card
+		bool found_on_card = false;
+		while (!found_on_card)
+		{
+			int dev;
+
+			// Get the next device
+			if ((err = snd_ctl_rawmidi_next_device(ctl, &dev)) < 0)
+			{
+				break;
+			}
+
+			// If we've reached the last device, break out of the loop
+			if (dev < 0)
+			{
+				break;
+			}
+
+			// Allocate the info structure
+			snd_rawmidi_info_t *info;
+			snd_rawmidi_info_malloc(&info);
+
+			// Get information about the device
+			snd_rawmidi_info_set_device(info, dev);
+			snd_rawmidi_info_set_subdevice(info, 0);
+			snd_rawmidi_info_set_stream(info, SND_RAWMIDI_STREAM_INPUT);
+			if ((err = snd_ctl_rawmidi_info(ctl, info)) < 0)
+			{
+				snd_rawmidi_info_free(info);
+				if (err != -ENOENT)
+				{
+					break;
+				}
+				continue;
+			}
+
+			const char *name = snd_rawmidi_info_get_name(info);
+
+			// Skip past non-Launchpad devices
+			if (strstr(name, "Launchpad") != NULL)
+			{
+				int subdevices_count = snd_rawmidi_info_get_subdevices_count(info);
+
+				for (int subdev = 0; subdev < subdevices_count; subdev++)
+				{
+					snd_rawmidi_info_set_subdevice(info, subdev);
+					if ((err = snd_ctl_rawmidi_info(ctl, info)) < 0)
+					{
+						break;
+					}
+					const char *subdevice_name = snd_rawmidi_info_get_subdevice_name(info);
+
+					// Skip past non-Launchpad and non-MIDI (i.e. DAW) devices
+					if (strstr(subdevice_name, "Launchpad") != NULL && strstr(subdevice_name, " MIDI ") != NULL)
+					{
+						LaunchpadDeviceAddress *device_address = &found[found_count];
+						if (stack_launchpad_trigger_get_card_id(ctl, device_address->id, sizeof(device_address->id)))
+						{
+							snprintf(device_address->address, sizeof(device_address->address), "hw:%d,%d,%d", card, dev, subdev);
+							device_address->profile = stack_launchpad_trigger_find_profile(name, subdevice_name);
+							found_count++;
+						}
+						found_on_card = true;
+						break;
+					}
+				}
+			}
+
+			snd_rawmidi_info_free(info);
+		}
+
+		// Tidy up
+		snd_ctl_close(ctl);
+	}
+
+	return found_count;
+}
+
+static LaunchpadButton *stack_launchpad_trigger_get_button(LaunchpadDevice *device, uint8_t column, uint8_t row)
+{
+	if (device == NULL || column < 1 || row < 1 || column > device->columns || row > device->rows)
+	{
+		return NULL;
+	}
+
+	return &device->buttons[(row - 1) * device->columns + column - 1];
+}
+
+// Returns the index of the LED of a button (by its column/row) within the
+// LEDs of a device, or -1 if the device doesn't have the button
+static int stack_launchpad_trigger_get_led(LaunchpadDevice *device, uint8_t column, uint8_t row)
+{
+	if (device == NULL || column > device->columns || row > device->rows)
+	{
+		return -1;
+	}
+
+	return stack_launchpad_trigger_button_index(column, row);
+}
+
+// Marks an LED as needing to be sent to the device. The caller should hold
+// led_mutex
+static void stack_launchpad_trigger_mark_dirty(LaunchpadDevice *device, int index)
+{
+	if (!device->leds.dirty[index])
+	{
+		device->leds.dirty[index] = true;
+
+		// Let the LED thread know that this device has changes to send
+		if (device->dirty_count++ == 0)
+		{
+			led_dirty_devices.push_back(device);
+		}
+		else
+		{
+			device->stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	else
+	{
+		device->stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// Changes how an LED is lit, marking it as needing to be sent if anything
+// changed. The caller should hold led_mutex
+static void stack_launchpad_trigger_set_led(LaunchpadDevice *device, int index, uint8_t mode, uint8_t r, uint8_t g, uint8_t b)
+{
+	if (stack_launchpad_trigger_light_led(&device->leds, index, mode, r, g, b))
+	{
+		stack_launchpad_trigger_mark_dirty(device, index);
+	}
+}
+
+// Changes how an LED is lit when its button isn't pressed, and lights it that
+// way. The caller should hold led_mutex
+static void stack_launchpad_trigger_set_base_led(LaunchpadDevice *device, int index, uint8_t mode, uint8_t r, uint8_t g, uint8_t b)
+{
+	device->leds.base[index] = {mode, r, g, b};
+	stack_launchpad_trigger_set_led(device, index, mode, r, g, b);
+}
+
+// Changes how a button is lit when not pressed on a page (0-based), lighting
+// it that way if the page is being shown. The caller should hold led_mutex
+static void stack_launchpad_trigger_set_frame_led(LaunchpadDevice *device, size_t page, uint8_t column, uint8_t row, uint8_t mode, uint8_t r, uint8_t g, uint8_t b)
+{
+	const int index = stack_launchpad_trigger_get_led(device, column, row);
+	if (index < 0 || page >= LAUNCHPAD_MAX_PAGES)
+	{
+		return;
+	}
+
+	device->frames[page][index] = {mode, r, g, b};
+	if (page == device->page.load())
+	{
+		stack_launchpad_trigger_set_base_led(device, index, mode, r, g, b);
+	}
+}
+
+// Lights every button as it should be on the page being shown. Only the
+// buttons that differ from the previous page get sent to the device. The
+// caller should hold led_mutex
+static void stack_launchpad_trigger_show_page(LaunchpadDevice *device)
+{
+	const LaunchpadFrameButton *frame = device->frames[device->page.load()];
+	for (uint8_t row = 1; row <= device->rows; row++)
+	{
+		for (uint8_t column = 1; column <= device->columns; column++)
+		{
+			const int index = stack_launchpad_trigger_button_index(column, row);
+			stack_launchpad_trigger_set_base_led(device, index, frame[index].mode, frame[index].r, frame[index].g, frame[index].b);
+		}
+	}
+}
+
+// Sets a button to a static colour to show that it was pressed at the given
+// time
+static void stack_launchpad_trigger_midi_set_color(LaunchpadDevice *device, uint8_t column, uint8_t row, uint8_t r, uint8_t g, uint8_t b, stack_time_t press_time)
+{
+	const int index = stack_launchpad_trigger_get_led(device, column, row);
+	if (index < 0)
+	{
+		return;
+	}
+
+	led_mutex.lock();
+	stack_launchpad_trigger_set_led(device, index, LAUNCHPAD_LED_STATIC, r, g, b);
+	if (device->echo_time == 0)
+	{
+		device->echo_time = press_time;
+	}
+	led_mutex.unlock();
+
+	led_condition.notify_one();
+}
+
+// Returns a button to how it is lit when not pressed
+static void stack_launchpad_trigger_midi_restore(LaunchpadDevice *device, uint8_t column, uint8_t row)
+{
+	const int index = stack_launchpad_trigger_get_led(device, column, row);
+	if (index < 0)
+	{
+		return;
+	}
+
+	led_mutex.lock();
+	const LaunchpadFrameButton base = device->leds.base[index];
+	stack_launchpad_trigger_set_led(device, index, base.mode, base.r, base.g, base.b);
+	led_mutex.unlock();
+
+	led_condition.notify_one();
+}
+
+// Returns the state of the cue of a trigger, as it should be shown on the
+// trigger's button
+static LaunchpadFeedbackState stack_launchpad_trigger_get_feedback_state(StackLaunchpadTrigger *trigger)
+{
+	switch (STACK_TRIGGER(trigger)->cue->state)
+	{
+		case STACK_CUE_STATE_PLAYING_PRE:
+			return LAUNCHPAD_FEEDBACK_PRE_WAIT;
+		case STACK_CUE_STATE_PLAYING_ACTION:
+		case STACK_CUE_STATE_PLAYING_POST:
+			return LAUNCHPAD_FEEDBACK_PLAYING;
+		case STACK_CUE_STATE_PAUSED:
+			return LAUNCHPAD_FEEDBACK_PAUSED;
+		default:
+			return LAUNCHPAD_FEEDBACK_IDLE;
+	}
+}
+
+// Sets how a button is lit on a page (0-based) from the last seen state of the
+// cues of the triggers on it that show their state. Buttons with no such
+// triggers are left alone. The caller should hold list_mutex and led_mutex
+static void stack_launchpad_trigger_apply_feedback(LaunchpadDevice *device, const LaunchpadDispatchTable *table, size_t page, uint8_t column, uint8_t row)
+{
+	int index = stack_launchpad_trigger_button_index(column, row);
+	if (index < 0 || page >= table->pages.size())
+	{
+		return;
+	}
+
+	// Page and global buttons take priority
+	if (stack_launchpad_trigger_get_page_button(table, column, row) >= 0 || (table->cue_list_triggers.size() > 0 && stack_launchpad_trigger_get_global_button(table, column, row) != NULL))
+	{
+		return;
+	}
+
+	// If more than one cue is shown, show the most active
+	const LaunchpadTriggerVector &triggers = table->pages[page].button_triggers[index];
+	bool feedback = false;
+	uint8_t state = LAUNCHPAD_FEEDBACK_IDLE;
+	for (auto trigger : triggers)
+	{
+		if (trigger->playback_feedback)
+		{
+			feedback = true;
+			if (trigger->feedback_state > state)
+			{
+				state = trigger->feedback_state;
+			}
+		}
+	}
+	if (!feedback)
+	{
+		return;
+	}
+
+	// All the triggers on a button share the same colour
+	const uint8_t r = triggers.front()->r, g = triggers.front()->g, b = triggers.front()->b;
+	switch (state)
+	{
+		case LAUNCHPAD_FEEDBACK_PLAYING:
+			stack_launchpad_trigger_set_frame_led(device, page, column, row, LAUNCHPAD_LED_PULSE, r, g, b);
+			break;
+		case LAUNCHPAD_FEEDBACK_PRE_WAIT:
+			stack_launchpad_trigger_set_frame_led(device, page, column, row, LAUNCHPAD_LED_FLASH, r, g, b);
+			break;
+		case LAUNCHPAD_FEEDBACK_PAUSED:
+			stack_launchpad_trigger_set_frame_led(device, page, column, row, LAUNCHPAD_LED_STATIC, r / 4, g / 4, b / 4);
+			break;
+		default:
+			stack_launchpad_trigger_set_frame_led(device, page, column, row, LAUNCHPAD_LED_STATIC, r, g, b);
+			break;
+	}
+}
+
+// Writes the given number of MIDI messages to the device, capturing what was
+// written. The caller should hold output_mutex
+static void stack_launchpad_trigger_midi_write(LaunchpadDevice *device, const unsigned char *data, size_t length, size_t messages)
+{
+	midi_backend->write(device->handle_out, data, length);
+	device->stats.bytes_sent.fetch_add(length, std::memory_order_relaxed);
+	device->stats.messages_sent.fetch_add(messages, std::memory_order_relaxed);
+	stack_launchpad_trigger_capture(device, LAUNCHPAD_CAPTURE_OUT, data, length, 0);
+}
+
+// Sends the LEDs of a device that differ from what we last sent it, in
+// whichever messages its profile finds cheapest. Both the LED thread and
+// closing the device flush, so the whole flush is done holding output_mutex:
+// what is encoded (and so recorded as sent) is always written before the next
+// flush encodes anything, keeping the messages in order on the device
+static void stack_launchpad_trigger_midi_flush(LaunchpadDevice *device)
+{
+	std::lock_guard<std::mutex> output_lock(device->output_mutex);
+
+	// Gather up the changed buttons
+	LaunchpadLedOutput output;
+	led_mutex.lock();
+	if (device->dirty_count == 0)
+	{
+		led_mutex.unlock();
+		return;
+	}
+	const size_t changed_count = device->profile->encode_leds(&device->leds, &output);
+	device->dirty_count = 0;
+	const stack_time_t echo_time = device->echo_time;
+	device->echo_time = 0;
+	led_mutex.unlock();
+
+	// Send the events
+	if (device->ready && device->handle_out != NULL)
+	{
+		const stack_time_t start_time = stack_get_clock_time();
+		if (output.short_length > 0)
+		{
+			stack_launchpad_trigger_midi_write(device, output.short_data, output.short_length, output.short_messages);
+		}
+		if (output.sysex_length > 0)
+		{
+			stack_launchpad_trigger_midi_write(device, output.sysex_data, output.sysex_length, 1);
+		}
+		midi_backend->drain(device->handle_out);
+		const stack_time_t end_time = stack_get_clock_time();
+		if (echo_time != 0)
+		{
+			stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_ECHO, end_time - echo_time);
+		}
+
+		if (output.short_length > 0 || output.sysex_length > 0)
+		{
+			// Flushes are serialised by output_mutex, but the maximum is still
+			// raised with a compare-and-swap so that a smaller time can never
+			// overwrite a larger one, whoever else updates it
+			LaunchpadDeviceStats *stats = &device->stats;
+			const uint64_t flush_time = end_time - start_time;
+			stats->flushes.fetch_add(1, std::memory_order_relaxed);
+			stats->flush_time.fetch_add(flush_time, std::memory_order_relaxed);
+			stats->leds_sent.fetch_add(changed_count, std::memory_order_relaxed);
+			uint64_t current_max = stats->flush_time_max.load(std::memory_order_relaxed);
+			while (flush_time > current_max && !stats->flush_time_max.compare_exchange_weak(current_max, flush_time, std::memory_order_relaxed))
+			{
+			}
+		}
+	}
+}
+
+// Puts the device in to the layout that our addresses and note/CC lighting
+// messages are for
+static void stack_launchpad_trigger_midi_programmer_mode(LaunchpadDevice *device)
+{
+	unsigned char output[LAUNCHPAD_MAX_PROGRAMMER_MODE_SIZE];
+	const size_t length = device->profile->encode_programmer_mode(output);
+
+	device->output_mutex.lock();
+	if (device->handle_out != NULL)
+	{
+		stack_launchpad_trigger_midi_write(device, output, length, 1);
+		midi_backend->drain(device->handle_out);
+	}
+	device->output_mutex.unlock();
+}
+
+// The LED thread, which sends colour changes to the devices so that the MIDI
+// thread (and the UI) don't have to wait for the USB transfers to complete
+static void stack_launchpad_trigger_led_thread(void *user_data)
+{
+	std::vector<LaunchpadDevice*> flush_devices;
+	flush_devices.reserve(LAUNCHPAD_MAX_DEVICES);
+
+	std::unique_lock<std::mutex> lock(led_mutex);
+	while (led_thread_running)
+	{
+		led_condition.wait(lock, []() { return !led_thread_running || led_dirty_devices.size() > 0; });
+		if (!led_thread_running)
+		{
+			break;
+		}
+
+		flush_devices.swap(led_dirty_devices);
+		lock.unlock();
+		for (auto device : flush_devices)
+		{
+			stack_launchpad_trigger_midi_flush(device);
+		}
+		flush_devices.clear();
+
+		// Limit the rate that we send at, which gives any further changes a
+		// chance to be combined in to the next message
+		std::this_thread::sleep_for(std::chrono::milliseconds(LED_FLUSH_INTERVAL_MS));
+		lock.lock();
+	}
+}
+
+// Forgets what the device is showing and marks all the buttons as changed,
+// so that the LED thread sends every button colour to the device in a single
+// message
+static void stack_launchpad_trigger_midi_refresh_colors(LaunchpadDevice *device)
+{
+	led_mutex.lock();
+	for (size_t i = 0; i < LAUNCHPAD_MAX_BUTTONS; i++)
+	{
+		device->leds.sent[i].mode = LAUNCHPAD_LED_UNKNOWN;
+	}
+	for (uint8_t row = 1; row <= device->rows; row++)
+	{
+		for (uint8_t column = 1; column <= device->columns; column++)
+		{
+			stack_launchpad_trigger_mark_dirty(device, stack_launchpad_trigger_button_index(column, row));
+		}
+	}
+	led_mutex.unlock();
+
+	led_condition.notify_one();
+}
+
+// Sets all the colors in the grid to black
+static void stack_launchpad_trigger_midi_all_off(LaunchpadDevice *device)
+{
+	// Set all the colors in our local grid
+	led_mutex.lock();
+	LaunchpadLeds *leds = &device->leds;
+	memset(leds->mode, LAUNCHPAD_LED_STATIC, sizeof(leds->mode));
+	memset(leds->r, 0, sizeof(leds->r));
+	memset(leds->g, 0, sizeof(leds->g));
+	memset(leds->b, 0, sizeof(leds->b));
+	memset(leds->palette, 0, sizeof(leds->palette));
+	memset(leds->palette_exact, true, sizeof(leds->palette_exact));
+	led_mutex.unlock();
+
+	// Send all the updates in one message
+	stack_launchpad_trigger_midi_refresh_colors(device);
+}
+
+// Rebuilds the dispatch table of a device and how each of its buttons is lit
+// on every page, then relights the whole device. The caller should hold
+// list_mutex
+static void stack_launchpad_trigger_update_buttons(LaunchpadDevice *device)
+{
+	// Rebuild the dispatch table (as this is called when a device is found,
+	// with triggers that were waiting for it, and when the global buttons
+	// change)
+	LaunchpadDispatchTable *table = stack_launchpad_trigger_build_dispatch(device, NULL);
+	const size_t page_count = table->pages.size();
+
+	// Global buttons take priority over the colour of any trigger on the same
+	// button, so update the colour of those triggers to match
+	const bool use_global_buttons = table->cue_list_triggers.size() > 0;
+	if (use_global_buttons)
+	{
+		for (size_t i = 0; i < GLOBAL_BUTTON_COUNT; i++)
+		{
+			const LaunchpadGlobalButton *global_button = &global_buttons[i];
+			const int index = stack_launchpad_trigger_button_index(global_button->column, global_button->row);
+			if (index < 0)
+			{
+				continue;
+			}
+			for (auto &page : table->pages)
+			{
+				for (auto trigger : page.button_triggers[index])
+				{
+					trigger->r = global_button->r;
+					trigger->g = global_button->g;
+					trigger->b = global_button->b;
+				}
+			}
+		}
+	}
+
+	// Page buttons only cover triggers when there are too many of both to
+	// fit, but then those triggers won't fire, so say which they are
+	for (size_t page_button = 0; page_button < table->page_button_count; page_button++)
+	{
+		const int index = table->page_buttons[page_button];
+		for (size_t page = 0; page < page_count; page++)
+		{
+			for (auto trigger : table->pages[page].button_triggers[index])
+			{
+				stack_log("stack_launchpad_trigger_update_buttons(): Trigger at column %d, row %d on page %zu is covered by the button for page %zu, and won't fire\n", (int)trigger->column, (int)trigger->row, page + 1, page_button + 1);
+			}
+		}
+	}
+
+	led_mutex.lock();
+
+	// Build how each page looks, so that changing page is just a copy
+	for (size_t page = 0; page < page_count; page++)
+	{
+		LaunchpadFrameButton *frame = device->frames[page];
+		for (uint8_t row = 1; row <= LAUNCHPAD_MAX_ROWS; row++)
+		{
+			for (uint8_t column = 1; column <= LAUNCHPAD_MAX_COLUMNS; column++)
+			{
+				const int index = stack_launchpad_trigger_button_index(column, row);
+				const LaunchpadTriggerVector &triggers = table->pages[page].button_triggers[index];
+				frame[index] = {LAUNCHPAD_LED_STATIC, 0, 0, 0};
+				if (triggers.size() > 0)
+				{
+					frame[index] = {LAUNCHPAD_LED_STATIC, triggers.back()->r, triggers.back()->g, triggers.back()->b};
+				}
+			}
+		}
+
+		if (use_global_buttons)
+		{
+			for (size_t i = 0; i < GLOBAL_BUTTON_COUNT; i++)
+			{
+				const LaunchpadGlobalButton *global_button = &global_buttons[i];
+				const int index = stack_launchpad_trigger_button_index(global_button->column, global_button->row);
+				if (index >= 0)
+				{
+					frame[index] = {LAUNCHPAD_LED_STATIC, global_button->r, global_button->g, global_button->b};
+				}
+			}
+		}
+
+		// The button for the page itself is lit brightly, the others dimly
+		for (size_t other_page = 0; other_page < table->page_button_count; other_page++)
+		{
+			const int index = table->page_buttons[other_page];
+			frame[index] = other_page == page ? LaunchpadFrameButton{LAUNCHPAD_LED_STATIC, 255, 255, 255} : LaunchpadFrameButton{LAUNCHPAD_LED_STATIC, 30, 30, 30};
+		}
+	}
+	device->page_count = page_count;
+	memcpy(device->page_buttons, table->page_buttons, table->page_button_count);
+	if (device->page.load() >= page_count)
+	{
+		device->page = 0;
+	}
+
+	// Show the state of any cues that want it, and then light everything on
+	// the page we're showing
+	for (size_t page = 0; page < page_count; page++)
+	{
+		for (uint8_t row = 1; row <= LAUNCHPAD_MAX_ROWS; row++)
+		{
+			for (uint8_t column = 1; column <= LAUNCHPAD_MAX_COLUMNS; column++)
+			{
+				stack_launchpad_trigger_apply_feedback(device, table, page, column, row);
+			}
+		}
+	}
+	stack_launchpad_trigger_show_page(device);
+
+	led_mutex.unlock();
+
+	stack_launchpad_trigger_publish_dispatch(device, table);
+
+	// Only the buttons that now look different get sent
+	led_condition.notify_one();
+}
+
+// Returns whether a dispatch table has different pages or page buttons to
+// those that the frames of a device were built for. The caller should hold
+// list_mutex
+static bool stack_launchpad_trigger_page_buttons_changed(const LaunchpadDevice *device, const LaunchpadDispatchTable *table)
+{
+	return table->pages.size() != device->page_count || memcmp(table->page_buttons, device->page_buttons, table->page_button_count) != 0;
+}
+
+// Sets the colour of a button on a page (0-based) after a trigger has been
+// added to it. This must be called after the trigger has been added to the
+// dispatch table, and the caller should hold list_mutex
+static void stack_launchpad_trigger_add_button(LaunchpadDevice *device, size_t page, uint8_t column, uint8_t row, int8_t r, int8_t g, int8_t b)
+{
+	// Adding a page means there are new page buttons to light, as does
+	// moving them off the trigger's button
+	const LaunchpadDispatchTable *table = device->dispatch.load();
+	if (stack_launchpad_trigger_page_buttons_changed(device, table))
+	{
+		stack_launchpad_trigger_update_buttons(device);
+		return;
+	}
+
+	// Check to see if any other triggers are using this button and update their color
+	int index = stack_launchpad_trigger_button_index(column, row);
+	if (index < 0 || page >= table->pages.size())
+	{
+		return;
+	}
+	for (auto trigger : table->pages[page].button_triggers[index])
+	{
+		trigger->r = r;
+		trigger->g = g;
+		trigger->b = b;
+	}
+
+	// Page and global buttons keep their own colour
+	if (stack_launchpad_trigger_get_page_button(table, column, row) >= 0 || (table->cue_list_triggers.size() > 0 && stack_launchpad_trigger_get_global_button(table, column, row) != NULL))
+	{
+		return;
+	}
+
+	led_mutex.lock();
+	stack_launchpad_trigger_set_frame_led(device, page, column, row, LAUNCHPAD_LED_STATIC, r, g, b);
+	stack_launchpad_trigger_apply_feedback(device, table, page, column, row);
+	led_mutex.unlock();
+	led_condition.notify_one();
+}
+
+// Turns a button on a page (0-based) off if no longer in use after a trigger
+// has been removed from it. This must be called after the trigger has been
+// removed from the dispatch table, and the caller should hold list_mutex
+static void stack_launchpad_trigger_remove_button(LaunchpadDevice *device, size_t page, uint8_t column, uint8_t row)
+{
+	// Removing a page means there are page buttons to turn off, and moving
+	// them back on to the trigger's button means they need lighting
+	const LaunchpadDispatchTable *table = device->dispatch.load();
+	if (stack_launchpad_trigger_page_buttons_changed(device, table))
+	{
+		stack_launchpad_trigger_update_buttons(device);
+		return;
+	}
+
+	int index = stack_launchpad_trigger_button_index(column, row);
+	if (index < 0 || page >= table->pages.size())
+	{
+		return;
+	}
+
+	// Page and global buttons keep their own colour
+	if (stack_launchpad_trigger_get_page_button(table, column, row) >= 0 || (table->cue_list_triggers.size() > 0 && stack_launchpad_trigger_get_global_button(table, column, row) != NULL))
+	{
+		return;
+	}
+
+	led_mutex.lock();
+	const LaunchpadTriggerVector &triggers = table->pages[page].button_triggers[index];
+	if (triggers.size() == 0)
+	{
+		stack_launchpad_trigger_set_frame_led(device, page, column, row, LAUNCHPAD_LED_STATIC, 0, 0, 0);
+	}
+	else
+	{
+		// The trigger we removed might have been the one showing its state
+		stack_launchpad_trigger_set_frame_led(device, page, column, row, LAUNCHPAD_LED_STATIC, triggers.front()->r, triggers.front()->g, triggers.front()->b);
+		stack_launchpad_trigger_apply_feedback(device, table, page, column, row);
+	}
+	led_mutex.unlock();
+	led_condition.notify_one();
+}
+
+// Rebuilds the buttons of every device. The caller should hold list_mutex
+static void stack_launchpad_trigger_update_all_buttons()
+{
+	device_mutex.lock();
+	std::vector<LaunchpadDevice*> update_devices = devices;
+	device_mutex.unlock();
+
+	for (auto device : update_devices)
+	{
+		stack_launchpad_trigger_update_buttons(device);
+	}
+}
+
+// Locks (or unlocks) a region of memory used by the MIDI thread, returning
+// false if the system doesn't allow it
+static bool stack_launchpad_trigger_lock_region(const void *address, size_t length, bool lock)
+{
+	if (lock ? mlock(address, length) != 0 : munlock(address, length) != 0)
+	{
+		if (lock)
+		{
+			stack_log("stack_launchpad_trigger_lock_region(): Failed to lock memory: %s\n", strerror(errno));
+		}
+		return false;
+	}
+
+	return true;
+}
+
+// Locks (or unlocks) the memory of a device. The caller should hold
+// device_mutex
+static bool stack_launchpad_trigger_lock_device(LaunchpadDevice *device, bool lock)
+{
+	bool result = stack_launchpad_trigger_lock_region(device, sizeof(LaunchpadDevice), lock);
+	result = stack_launchpad_trigger_lock_region(device->buttons, (size_t)device->rows * device->columns * sizeof(LaunchpadButton), lock) && result;
+	return result;
+}
+
+// Forgets which buttons are held, and any pressure changes or timers that are
+// waiting. Only called by the MIDI thread
+static void stack_launchpad_trigger_reset_buttons(LaunchpadDevice *device)
+{
+	for (size_t i = 0; i < (size_t)device->rows * device->columns; i++)
+	{
+		device->buttons[i].held = false;
+		device->buttons[i].pressure_pending = false;
+		device->buttons[i].timer_time = 0;
+		device->buttons[i].queued = false;
+	}
+	device->pressure_pending_count = 0;
+	device->timer_count = 0;
+}
+
+// Creates a new (not yet opened) device of the given model and adds it to our
+// list of devices. The caller should hold device_mutex
+static LaunchpadDevice *stack_launchpad_trigger_new_device(const char *id, const LaunchpadProfile *profile)
+{
+	LaunchpadDevice *device = new LaunchpadDevice();
+	snprintf(device->id, sizeof(device->id), "%s", id);
+	device->index = devices.size();
+	device->handle_in = NULL;
+	device->handle_out = NULL;
+	device->ready = false;
+	device->address[0] = '\0';
+	device->timestamped = false;
+	device->profile = profile;
+	device->rows = profile->rows;
+	device->columns = profile->columns;
+	device->buttons = new LaunchpadButton[device->rows * device->columns];
+	memset(device->buttons, 0, device->columns * device->rows * sizeof(LaunchpadButton));
+	memset(&device->leds, 0, sizeof(device->leds));
+	for (size_t i = 0; i < LAUNCHPAD_MAX_BUTTONS; i++)
+	{
+		device->leds.sent[i].mode = LAUNCHPAD_LED_UNKNOWN;
+	}
+	device->dirty_count = 0;
+	device->echo_time = 0;
+	device->pressure_pending_count = 0;
+	device->last_pressure_time = 0;
+	device->timer_count = 0;
+	device->dispatch = new LaunchpadDispatchTable();
+	device->dispatch.load()->pages.resize(1);
+	memset(device->frames, 0, sizeof(device->frames));
+	device->page = 0;
+	device->page_count = 1;
+	memset(device->page_buttons, 0, sizeof(device->page_buttons));
+	devices.push_back(device);
+	if (thread_memory_locked)
+	{
+		stack_launchpad_trigger_lock_device(device, true);
+	}
+	if (default_device.load() == NULL)
+	{
+		default_device = device;
+	}
+
+	return device;
+}
+
+// Returns the device with the given ID, or NULL if we've not found one. The
+// caller should hold device_mutex
+static LaunchpadDevice *stack_launchpad_trigger_find_device(const char *id)
+{
+	for (auto device : devices)
+	{
+		if (strcmp(device->id, id) == 0)
+		{
+			return device;
+		}
+	}
+
+	return NULL;
+}
+
+// Marks a device that has just been opened as ready, and sets up its LEDs
+static void stack_launchpad_trigger_device_opened(LaunchpadDevice *device)
+{
+	stack_log("stack_launchpad_trigger_device_opened(): Opened %s at %s\n", device->id, device->address);
+	stack_launchpad_trigger_capture(device, LAUNCHPAD_CAPTURE_OPENED, NULL, 0, 0);
+	device->stats.opens.fetch_add(1, std::memory_order_relaxed);
+
+	list_mutex.lock();
+	stack_launchpad_trigger_parser_reset(&device->parser);
+
+	// Forget about anything that was held when the device went away
+	stack_launchpad_trigger_reset_buttons(device);
+
+	// Make sure the device is using the layout we expect before we light
+	// anything (it may have been left in another mode)
+	stack_launchpad_trigger_midi_programmer_mode(device);
+	device->ready = true;
+
+	// Ensure all the LEDs are set correctly. We don't know what the device is
+	// showing, so everything gets sent
+	stack_launchpad_trigger_midi_refresh_colors(device);
+	stack_launchpad_trigger_update_buttons(device);
+	list_mutex.unlock();
+}
+
+// Opens all the Launchpads that are connected but that we don't have open.
+// This is only called by the MIDI thread, which is the only thread that opens
+// devices, so we don't need to hold the lock whilst we (potentially slowly)
+// search for and open them
+static void stack_launchpad_trigger_open_devices()
+{
+	static bool shown_missing_error = false;
+
+	// Take a copy of our device list
+	LaunchpadDevice *known_devices[LAUNCHPAD_MAX_DEVICES];
+	size_t known_count = 0;
+	device_mutex.lock();
+	for (auto device : devices)
+	{
+		known_devices[known_count++] = device;
+	}
+	device_mutex.unlock();
+
+	// Try the address each device was last found at first, as this saves us
+	// from scanning every sound card on a reconnect
+	size_t ready_count = 0;
+	for (size_t i = 0; i < known_count; i++)
+	{
+		LaunchpadDevice *device = known_devices[i];
+		if (!device->ready && device->address[0] != '\0' && midi_backend->open(device, device->address))
+		{
+			stack_launchpad_trigger_device_opened(device);
+		}
+		if (device->ready)
+		{
+			ready_count++;
+		}
+	}
+
+	// Look for devices that have moved or that we've not seen before
+	LaunchpadDeviceAddress found[LAUNCHPAD_MAX_DEVICES];
+	size_t found_count = stack_launchpad_trigger_find_devices(found, LAUNCHPAD_MAX_DEVICES);
+	for (size_t i = 0; i < found_count; i++)
+	{
+		device_mutex.lock();
+		LaunchpadDevice *device = stack_launchpad_trigger_find_device(found[i].id);
+		if (device == NULL && devices.size() >= LAUNCHPAD_MAX_DEVICES)
+		{
+			device_mutex.unlock();
+			stack_log("stack_launchpad_trigger_open_devices(): Ignoring device %s as we already have the maximum number of devices\n", found[i].id);
+			continue;
+		}
+		else if (device == NULL)
+		{
+			stack_log("stack_launchpad_trigger_open_devices(): Found new device %s (%s)\n", found[i].id, found[i].profile->name);
+			device = stack_launchpad_trigger_new_device(found[i].id, found[i].profile);
+		}
+		device_mutex.unlock();
+
+		if (device->ready)
+		{
+			continue;
+		}
+
+		// Open the MIDI in/out devices
+		if (midi_backend->open(device, found[i].address))
+		{
+			stack_launchpad_trigger_device_opened(device);
+			ready_count++;
+		}
+		else
+		{
+			stack_log("stack_launchpad_trigger_open_devices(): Failed to open MIDI devices at %s\n", found[i].address);
+		}
+	}
+
+	// Only show this error once
+	if (ready_count == 0 && !shown_missing_error)
+	{
+		stack_log("stack_launchpad_trigger_open_devices(): No Launchpad MIDI device found!\n");
+		shown_missing_error = true;
+	}
+	else if (ready_count > 0)
+	{
+		shown_missing_error = false;
+	}
+}
+
+static void stack_launchpad_trigger_close_device(LaunchpadDevice *device)
+{
+	if (device == NULL)
+	{
+		return;
+	}
+
+	if (device->handle_out != NULL)
+	{
+		// Clear all the buttons at once. We send this ourselves rather than
+		// waiting for the LED thread as we're about to close the device
+		stack_launchpad_trigger_midi_all_off(device);
+		stack_launchpad_trigger_midi_flush(device);
+
+		device->output_mutex.lock();
+		device->ready = false;
+		midi_backend->drain(device->handle_out);
+		midi_backend->close(device->handle_out);
+		stack_log("stack_launchpad_trigger_close_device(): MIDI Out closed\n");
+		device->handle_out = NULL;
+		device->output_mutex.unlock();
+	}
+
+	device->ready = false;
+
+	if (device->handle_in != NULL)
+	{
+		midi_backend->close(device->handle_in);
+		stack_log("stack_launchpad_trigger_close_device(): MIDI In closed\n");
+		device->handle_in = NULL;
+	}
+
+	stack_launchpad_trigger_capture(device, LAUNCHPAD_CAPTURE_CLOSED, NULL, 0, 0);
+
+	// Make sure the thread isn't left polling the closed device
+	stack_launchpad_trigger_wake_thread();
+
+	// We keep the device (and its button array) about in case it comes back
+}
+
+// Shows the state of the cue of a trigger on its button if it has changed
+// since we last looked. The caller should hold list_mutex
+static void stack_launchpad_trigger_check_feedback(StackLaunchpadTrigger *trigger)
+{
+	if (!trigger->playback_feedback)
+	{
+		return;
+	}
+
+	LaunchpadFeedbackState state = stack_launchpad_trigger_get_feedback_state(trigger);
+	if (state == trigger->feedback_state)
+	{
+		return;
+	}
+	trigger->feedback_state = state;
+
+	LaunchpadDevice *device = stack_launchpad_trigger_get_trigger_device(trigger);
+	if (device == NULL)
+	{
+		return;
+	}
+
+	// The device animates the button itself, so this is only sent when the
+	// state changes
+	led_mutex.lock();
+	stack_launchpad_trigger_apply_feedback(device, device->dispatch.load(), trigger->page - 1, trigger->column, trigger->row);
+	led_mutex.unlock();
+	led_condition.notify_one();
+}
+
+// Shows the state of the cues of all the triggers that show it, where it has
+// changed. Only the UI thread changes feedback_state, so this compares it
+// without list_mutex and only takes the lock if there's something to show.
+// Only called by the UI thread
+static void stack_launchpad_trigger_check_all_feedback()
+{
+	bool changed = false;
+	for (auto trigger : feedback_triggers)
+	{
+		if (stack_launchpad_trigger_get_feedback_state(trigger) != trigger->feedback_state)
+		{
+			changed = true;
+			break;
+		}
+	}
+	if (!changed)
+	{
+		return;
+	}
+
+	list_mutex.lock();
+	for (auto trigger : feedback_triggers)
+	{
+		stack_launchpad_trigger_check_feedback(trigger);
+	}
+	list_mutex.unlock();
+}
+
+// Main loop callback that picks up state changes of cues that Stack makes
+// without telling us (e.g. cues finishing, or being started from the UI)
+static gboolean stack_launchpad_trigger_feedback_timer(gpointer user_data)
+{
+	stack_launchpad_trigger_check_all_feedback();
+	return G_SOURCE_CONTINUE;
+}
+
+// Stops looking for changes in the state of cues, forgetting all the triggers
+// that show them. Only called by the UI thread
+static void stack_launchpad_trigger_stop_feedback()
+{
+	feedback_triggers.clear();
+	if (feedback_source != 0)
+	{
+		g_source_remove(feedback_source);
+		feedback_source = 0;
+	}
+}
+
+// Adds a trigger to (or removes it from) the triggers that show the state of
+// their cue, starting the feedback timer for the first and stopping it after
+// the last. Only called by the UI thread
+static void stack_launchpad_trigger_watch_feedback(StackLaunchpadTrigger *trigger, bool watch)
+{
+	auto position = std::find(feedback_triggers.begin(), feedback_triggers.end(), trigger);
+	if (watch && position == feedback_triggers.end())
+	{
+		feedback_triggers.push_back(trigger);
+	}
+	else if (!watch && position != feedback_triggers.end())
+	{
+		feedback_triggers.erase(position);
+	}
+
+	if (feedback_triggers.size() > 0 && feedback_source == 0)
+	{
+		feedback_source = g_timeout_add(LAUNCHPAD_FEEDBACK_INTERVAL_MS, stack_launchpad_trigger_feedback_timer, NULL);
+	}
+	else if (feedback_triggers.size() == 0)
+	{
+		stack_launchpad_trigger_stop_feedback();
+	}
+}
+
+// Lets the UI thread know that there are actions waiting
+static void stack_launchpad_trigger_signal_actions()
+{
+	uint64_t value = 1;
+	if (write(action_queue.event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	{
+		stack_log("stack_launchpad_trigger_signal_actions(): Failed to signal UI thread: %d\n", errno);
+	}
+}
+
+// Queues an action for a trigger to be run on the UI thread. This is only
+// called from the MIDI thread, and never blocks. The trigger must have come
+// from a dispatch table, so that it can't be destroyed whilst we queue it.
+// Within a batch, the action isn't run until the batch is ended
+static void stack_launchpad_trigger_queue_action(LaunchpadActionType type, StackLaunchpadTrigger *trigger, LaunchpadCueListCommand command, uint8_t pressure, stack_time_t time)
+{
+	size_t head = action_queue.head.load(std::memory_order_relaxed) + action_queue.batch_count;
+	if (head - action_queue.tail.load(std::memory_order_acquire) >= LAUNCHPAD_ACTION_QUEUE_SIZE)
+	{
+		stack_log("stack_launchpad_trigger_queue_action(): Action queue full, dropping action\n");
+		action_queue.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	LaunchpadAction *action = &action_queue.actions[head & (LAUNCHPAD_ACTION_QUEUE_SIZE - 1)];
+	action->type = type;
+	action->trigger = trigger;
+	action->action = stack_trigger_get_action(STACK_TRIGGER(trigger));
+	action->command = command;
+	action->pressure = pressure;
+	action->time = time;
+	action->queued_time = stack_get_clock_time();
+	action->batch_continues = action_queue.batching;
+	if (action_queue.batching)
+	{
+		action_queue.batch_count++;
+		return;
+	}
+	action_queue.head.store(head + 1, std::memory_order_release);
+	stack_launchpad_trigger_signal_actions();
+}
+
+// Starts a batch of actions from one button press, which the UI thread runs
+// together. Only called from the MIDI thread
+static void stack_launchpad_trigger_begin_actions()
+{
+	action_queue.batching = true;
+	action_queue.batch_count = 0;
+}
+
+// Ends a batch of actions, handing all of them to the UI thread at once
+static void stack_launchpad_trigger_end_actions()
+{
+	action_queue.batching = false;
+	if (action_queue.batch_count == 0)
+	{
+		return;
+	}
+
+	const size_t head = action_queue.head.load(std::memory_order_relaxed);
+	action_queue.actions[(head + action_queue.batch_count - 1) & (LAUNCHPAD_ACTION_QUEUE_SIZE - 1)].batch_continues = false;
+	action_queue.head.store(head + action_queue.batch_count, std::memory_order_release);
+	action_queue.batch_count = 0;
+	stack_launchpad_trigger_signal_actions();
+}
+
+// Sets the live playback volume of a cue from the pressure on its button. Cues
+// that don't have a volume are left alone
+static void stack_launchpad_trigger_apply_pressure(StackLaunchpadTrigger *trigger, uint8_t pressure)
+{
+	// Map the pressure on to a level between zero and one
+	double level = (double)pressure / 127.0;
+	switch (trigger->pressure_curve)
+	{
+		case LAUNCHPAD_PRESSURE_CURVE_NONE:
+			return;
+		case LAUNCHPAD_PRESSURE_CURVE_LINEAR:
+			break;
+		case LAUNCHPAD_PRESSURE_CURVE_SOFT:
+			level = sqrt(level);
+			break;
+		case LAUNCHPAD_PRESSURE_CURVE_HARD:
+			level = level * level;
+			break;
+	}
+
+	StackProperty *property = stack_cue_get_property(STACK_TRIGGER(trigger)->cue, "play_volume");
+	if (property == NULL)
+	{
+		return;
+	}
+
+	double volume = level > 0.0 ? 20.0 * log10(level) : LAUNCHPAD_PRESSURE_MIN_DB;
+	if (volume < LAUNCHPAD_PRESSURE_MIN_DB)
+	{
+		volume = LAUNCHPAD_PRESSURE_MIN_DB;
+	}
+	stack_property_set_double(property, STACK_PROPERTY_VERSION_LIVE, volume);
+}
+
+// Returns when an action should be run: either the time of the button press
+// that caused it plus the fixed latency, or now if actions aren't scheduled
+static stack_time_t stack_launchpad_trigger_action_due_time(const LaunchpadAction *action)
+{
+	if (!schedule_actions)
+	{
+		return stack_get_clock_time();
+	}
+
+	return action->time + (stack_time_t)start_offset_ms * NANOSECS_PER_MILLISEC;
+}
+
+// Runs the action of a LAUNCHPAD_ACTION_TRIGGER action on its cue. The caller
+// should hold the lock of the cue's cue list
+static void stack_launchpad_trigger_run_trigger_action(LaunchpadAction *action)
+{
+	StackCue *cue = STACK_TRIGGER(action->trigger)->cue;
+	const stack_time_t due_time = stack_launchpad_trigger_action_due_time(action);
+	switch (action->action)
+	{
+		case STACK_TRIGGER_ACTION_STOP:
+			stack_cue_stop(cue);
+			break;
+		case STACK_TRIGGER_ACTION_PAUSE:
+			stack_cue_pause(cue);
+			break;
+		case STACK_TRIGGER_ACTION_PLAY:
+			// Set the volume from how hard the button was pressed as soon
+			// as the cue has started
+			if (stack_cue_play(cue))
+			{
+				// The main loop only gets to us a little after the action
+				// was due, so run the cue's timeline from when it was due.
+				// This keeps cues started from a roll of presses evenly
+				// spaced. Cues are never started later than when we played
+				// them
+				if (schedule_actions && cue->start_time > due_time)
+				{
+					cue->start_time = due_time;
+				}
+
+				if (action->pressure > 0)
+				{
+					stack_launchpad_trigger_apply_pressure(action->trigger, action->pressure);
+				}
+			}
+			break;
+	}
+}
+
+// Runs a cue list command in a window, calling the window and cue list
+// directly rather than going through their key bindings
+static void stack_launchpad_trigger_run_command(StackAppWindow *window, LaunchpadCueListCommand command)
+{
+	switch (command)
+	{
+		case LAUNCHPAD_COMMAND_GO:
+			if (window->selected_cue != NULL)
+			{
+				stack_cue_list_lock(window->cue_list);
+				stack_cue_play(window->selected_cue);
+				stack_cue_list_unlock(window->cue_list);
+				saw_select_next_cue(window);
+			}
+			break;
+		case LAUNCHPAD_COMMAND_UP:
+		case LAUNCHPAD_COMMAND_LEFT:
+			saw_select_previous_cue(window);
+			break;
+		case LAUNCHPAD_COMMAND_DOWN:
+		case LAUNCHPAD_COMMAND_RIGHT:
+			saw_select_next_cue(window);
+			break;
+	}
+}
+
+// Runs an action taken from the queue, other than those of batches
+static void stack_launchpad_trigger_run_action(LaunchpadAction *action)
+{
+	// Get the cue
+	StackCue *cue = STACK_TRIGGER(action->trigger)->cue;
+
+	if (action->type == LAUNCHPAD_ACTION_STOP_ALL)
+	{
+		// We have a function for this one
+		stack_cue_list_stop_all(cue->parent);
+		return;
+	}
+	else if (action->type == LAUNCHPAD_ACTION_COMMAND)
+	{
+		StackAppWindow *window = saw_get_window_for_cue(cue);
+		if (window != NULL)
+		{
+			stack_launchpad_trigger_run_command(window, action->command);
+		}
+		return;
+	}
+	else if (action->type == LAUNCHPAD_ACTION_PRESSURE)
+	{
+		stack_cue_list_lock(cue->parent);
+		stack_launchpad_trigger_apply_pressure(action->trigger, action->pressure);
+		stack_cue_list_unlock(cue->parent);
+		return;
+	}
+
+	// Run the correct action
+	stack_cue_list_lock(cue->parent);
+	stack_launchpad_trigger_run_trigger_action(action);
+	stack_cue_list_unlock(cue->parent);
+}
+
+static gboolean stack_launchpad_trigger_action_timer(gpointer user_data);
+
+// Runs all the actions waiting in the queue that are due. If actions are
+// scheduled and the next isn't due yet, a timer is set to run it when it is
+static void stack_launchpad_trigger_run_actions()
+{
+	size_t tail = action_queue.tail.load(std::memory_order_relaxed);
+	const size_t head = action_queue.head.load(std::memory_order_acquire);
+	while (tail != head)
+	{
+		// Wait for the next action if it isn't due yet. Actions are queued
+		// in the order that they're due, so nothing after it is either
+		const stack_time_t due_time = stack_launchpad_trigger_action_due_time(&action_queue.actions[tail & (LAUNCHPAD_ACTION_QUEUE_SIZE - 1)]);
+		const stack_time_t now = stack_get_clock_time();
+		if (due_time > now)
+		{
+			if (action_timer_source == 0)
+			{
+				const guint wait_ms = (guint)((due_time - now + NANOSECS_PER_MILLISEC - 1) / NANOSECS_PER_MILLISEC);
+				action_timer_source = g_timeout_add_full(G_PRIORITY_HIGH, wait_ms, stack_launchpad_trigger_action_timer, NULL, NULL);
+			}
+			break;
+		}
+
+		// Run everything from one button press together, so that layered
+		// cues all start in the same tick. The cue list is only locked once
+		// for all of them (unless they're on different cue lists)
+		size_t batch_end = tail;
+		StackCueList *locked_cue_list = NULL;
+		bool batch_continues = true;
+		while (batch_continues && batch_end != head)
+		{
+			LaunchpadAction *action = &action_queue.actions[batch_end & (LAUNCHPAD_ACTION_QUEUE_SIZE - 1)];
+			batch_continues = action->batch_continues;
+			batch_end++;
+			if (action->trigger == NULL)
+			{
+				continue;
+			}
+
+			if (action->type != LAUNCHPAD_ACTION_TRIGGER)
+			{
+				stack_launchpad_trigger_run_action(action);
+				continue;
+			}
+
+			StackCueList *cue_list = STACK_TRIGGER(action->trigger)->cue->parent;
+			if (cue_list != locked_cue_list)
+			{
+				if (locked_cue_list != NULL)
+				{
+					stack_cue_list_unlock(locked_cue_list);
+				}
+				stack_cue_list_lock(cue_list);
+				locked_cue_list = cue_list;
+			}
+			stack_launchpad_trigger_run_trigger_action(action);
+		}
+		if (locked_cue_list != NULL)
+		{
+			stack_cue_list_unlock(locked_cue_list);
+		}
+
+		const stack_time_t done_time = stack_get_clock_time();
+		bool state_changed = false;
+		for (; tail != batch_end; tail++)
+		{
+			LaunchpadAction *action = &action_queue.actions[tail & (LAUNCHPAD_ACTION_QUEUE_SIZE - 1)];
+			if (action->trigger == NULL)
+			{
+				continue;
+			}
+
+			if (action->type != LAUNCHPAD_ACTION_PRESSURE)
+			{
+				stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_EXECUTE, done_time - action->queued_time);
+				stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_TOTAL, done_time - action->time);
+			}
+
+			state_changed = state_changed || action->type != LAUNCHPAD_ACTION_PRESSURE;
+		}
+		action_queue.tail.store(tail, std::memory_order_release);
+
+		// Show the new state of the cues straight away. As well as the cues
+		// of the triggers that were pressed, this picks up those that the
+		// global buttons (or other triggers on the same cue) changed
+		if (state_changed)
+		{
+			stack_launchpad_trigger_check_all_feedback();
+		}
 	}
+}
 
-	return found;
+// Main loop callback that runs scheduled actions once they're due
+static gboolean stack_launchpad_trigger_action_timer(gpointer user_data)
+{
+	action_timer_source = 0;
+	stack_launchpad_trigger_run_actions();
+	return G_SOURCE_REMOVE;
 }
 
-static void stack_launchpad_trigger_address_to_col_row(unsigned char address, uint8_t *column, uint8_t *row)
+// Main loop callback that runs the actions waiting in the queue
+static gboolean stack_launchpad_trigger_action_ready(gint fd, GIOCondition condition, gpointer user_data)
 {
-	*row = 10 - ((address - 1) / 10);
-	*column = (address % 10);
+	uint64_t value;
+	if (read(fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	{
+		stack_log("stack_launchpad_trigger_action_ready(): Failed to read eventfd: %d\n", errno);
+	}
+
+	stack_launchpad_trigger_run_actions();
+	return G_SOURCE_CONTINUE;
 }
 
-// Returns the address of an LED based on its column/row (1-9)
-static unsigned char stack_launchpad_trigger_col_row_to_address(uint8_t column, uint8_t row)
+// Removes any actions for the given trigger from the queue. This must be
+// called from the UI thread, after the trigger has been removed from the
+// dispatch table (so that the MIDI thread can't queue any more actions for it)
+static void stack_launchpad_trigger_purge_actions(StackLaunchpadTrigger *trigger)
 {
-	return (10 - row) * 10 + column;
+	// As we're the consumer, the actions between the tail and the head are
+	// ours to modify. We blank the trigger out rather than removing it
+	size_t head = action_queue.head.load(std::memory_order_acquire);
+	for (size_t i = action_queue.tail.load(std::memory_order_relaxed); i != head; i++)
+	{
+		LaunchpadAction *action = &action_queue.actions[i & (LAUNCHPAD_ACTION_QUEUE_SIZE - 1)];
+		if (action->trigger == trigger)
+		{
+			action->trigger = NULL;
+		}
+	}
 }
 
-static LaunchpadButton *stack_launchpad_trigger_get_button(LaunchpadDevice *device, uint8_t column, uint8_t row)
+// Sets (or clears, if timer_time is zero) the timer of a button
+static void stack_launchpad_trigger_set_timer(LaunchpadDevice *device, LaunchpadButton *button, stack_time_t timer_time)
 {
-	if (device == NULL || column > device->columns || row > device->rows)
+	if (button->timer_time == 0 && timer_time != 0)
 	{
-		return NULL;
+		device->timer_count++;
+	}
+	else if (button->timer_time != 0 && timer_time == 0)
+	{
+		device->timer_count--;
 	}
+	button->timer_time = timer_time;
+}
 
-	return &device->buttons[(row - 1) * device->rows + column - 1];
+// Returns true if a trigger fires for a press of the given velocity
+static bool stack_launchpad_trigger_in_velocity_zone(const StackLaunchpadTrigger *trigger, uint8_t velocity)
+{
+	return velocity >= trigger->velocity_min && velocity <= trigger->velocity_max;
 }
 
-// Sets the button at the given address to the give RGB color (where r, g, and b are 0 - 255)
-static void stack_launchpad_trigger_midi_set_color(LaunchpadDevice *device, uint8_t column, uint8_t row, uint8_t r, uint8_t g, uint8_t b)
+// Queues the actions of all the triggers on a button that fire when it is
+// pressed (for the velocity of the press), as one batch, and sets the timer to do so again if the button is being held
+static void stack_launchpad_trigger_fire_button(LaunchpadDevice *device, const LaunchpadPage *page, int index, LaunchpadButton *button, stack_time_t time)
 {
-	LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
-	button->r = r;
-	button->g = g;
-	button->b = b;
+	const LaunchpadButtonPolicy *policy = &page->button_policies[index];
 
-	// Taken from the LED lighting SysEx message documentation found at
-	// https://fael-downloads-prod.focusrite.com/customer/prod/s3fs-public/downloads/Launchpad%20X%20-%20Programmers%20Reference%20Manual.pdf
-	unsigned char output[13] = {MIDI_SYSEX, 0x00, 0x20, 0x29, 0x02, 0x0C, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, MIDI_SYSEX_END};
-	output[8] = stack_launchpad_trigger_col_row_to_address(column, row);
-	// MIDI colours are from 0-127 (so as to keep the MSB a zero)
-	output[9] = r / 2;
-	output[10] = g / 2;
-	output[11] = b / 2;
+	button->last_press_time = time;
+	stack_launchpad_trigger_begin_actions();
+	for (auto trigger : page->button_triggers[index])
+	{
+		if (trigger->on_pressed && stack_launchpad_trigger_in_velocity_zone(trigger, button->velocity))
+		{
+			stack_launchpad_trigger_queue_action(LAUNCHPAD_ACTION_TRIGGER, trigger, LAUNCHPAD_COMMAND_GO, button->velocity, time);
+		}
+	}
+	stack_launchpad_trigger_end_actions();
 
-	// Send the event
-	if (device != NULL && device->ready)
+	button->queued = false;
+	if (button->held && policy->hold && policy->interval > 0)
+	{
+		stack_launchpad_trigger_set_timer(device, button, time + policy->interval);
+	}
+	else
 	{
-		snd_rawmidi_write(device->handle_out, output, 13);
-		snd_rawmidi_drain(device->handle_out);
+		stack_launchpad_trigger_set_timer(device, button, 0);
 	}
 }
 
-// Increments a buttons usage count, and sets the colour of the button
-static void stack_launchpad_trigger_add_button(LaunchpadDevice *device, uint8_t column, uint8_t row, int8_t r, int8_t g, int8_t b)
+// Fires any button timers that are due
+static void stack_launchpad_trigger_process_timers(LaunchpadDevice *device, const LaunchpadDispatchTable *table, stack_time_t time)
 {
-	LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
-	if (button != NULL)
+	const LaunchpadPage *page = stack_launchpad_trigger_get_shown_page(device, table);
+	for (size_t i = 0; device->timer_count > 0 && i < (size_t)device->rows * device->columns; i++)
 	{
-		button->usage_count++;
-		stack_launchpad_trigger_midi_set_color(device, column, row, r, g, b);
+		LaunchpadButton *button = &device->buttons[i];
+		if (button->timer_time == 0 || button->timer_time > time)
+		{
+			continue;
+		}
+
+		// The triggers may have been changed since the timer was set
+		int index = stack_launchpad_trigger_button_index(i % device->columns + 1, i / device->columns + 1);
+		if (index < 0 || page->button_triggers[index].size() == 0)
+		{
+			button->queued = false;
+			stack_launchpad_trigger_set_timer(device, button, 0);
+			continue;
+		}
+
+		// Fire at the time we were meant to, rather than when we got round
+		// to it, so that repeats stay evenly spaced
+		stack_launchpad_trigger_fire_button(device, page, index, button, button->timer_time);
 	}
+}
 
-	// Check to see if any other triggers are using this button and update their color
-	for (auto trigger : trigger_list)
+// Returns the time that the next button timer is due for a device, or -1 if
+// it has no timers
+static stack_time_t stack_launchpad_trigger_next_timer(LaunchpadDevice *device)
+{
+	stack_time_t next_time = -1;
+	for (size_t i = 0; device->timer_count > 0 && i < (size_t)device->rows * device->columns; i++)
 	{
-		if (trigger->column == column && trigger->row == row)
+		const stack_time_t timer_time = device->buttons[i].timer_time;
+		if (timer_time != 0 && (next_time < 0 || timer_time < next_time))
 		{
-			trigger->r = r;
-			trigger->g = g;
-			trigger->b = b;
+			next_time = timer_time;
 		}
 	}
+
+	return next_time;
 }
 
-// Decrements a buttons usage count and turns the button off if longer in use
-static void stack_launchpad_trigger_remove_button(LaunchpadDevice *device, uint8_t column, uint8_t row)
+// Changes the page (0-based) shown on a device. As how every page looks is
+// built in advance, this doesn't depend on the number of triggers
+static void stack_launchpad_trigger_select_page(LaunchpadDevice *device, uint8_t page)
 {
-	if (column == 0 || row == 0 || column > device->columns || row > device->rows)
+	if (page == device->page.load())
 	{
 		return;
 	}
 
+	// Anything held, queued or repeating belongs to the old page
+	stack_launchpad_trigger_reset_buttons(device);
+
+	led_mutex.lock();
+	device->page = page;
+	stack_launchpad_trigger_show_page(device);
+	led_mutex.unlock();
+	led_condition.notify_one();
+}
+
+// Processes a button press or release from the device using the given
+// dispatch table. The time is when the message was read from the device, and
+// parse_time is when we finished parsing it
+static void stack_launchpad_trigger_process_button(LaunchpadDevice *device, const LaunchpadDispatchTable *table, uint8_t address, uint8_t pressure, stack_time_t time, stack_time_t parse_time)
+{
+	// Get the button
+	LaunchpadButtonTarget target;
+	if (!stack_launchpad_trigger_resolve_button(device->profile, table, device->page.load(), address, &target))
+	{
+		return;
+	}
+	const uint8_t column = target.column, row = target.row;
+	const int index = target.index;
 	LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
-	if (button != NULL && button->usage_count > 0)
+
+	// Page buttons take precedence over everything else
+	if (target.page_button >= 0)
 	{
-		button->usage_count--;
-		if (button->usage_count == 0)
+		if (pressure > 0)
 		{
-			stack_launchpad_trigger_midi_set_color(device, column, row, 0, 0, 0);
+			stack_launchpad_trigger_select_page(device, target.page_button);
 		}
+		return;
 	}
-}
 
-// Sends a single, giant SysEx message to set all the button colours at once
-static void stack_launchpad_trigger_midi_refresh_colors(LaunchpadDevice *device)
-{
-	// Taken from the LED lighting SysEx message documentation found at
-	// https://fael-downloads-prod.focusrite.com/customer/prod/s3fs-public/downloads/Launchpad%20X%20-%20Programmers%20Reference%20Manual.pdf
-	// 413 = 9 rows * 9 columns * 5 bytes per button + 7 byte command prefix + 1 byte command suffix
-	unsigned char output[413] = {MIDI_SYSEX, 0x00, 0x20, 0x29, 0x02, 0x0C, 0x03};
+	// Keep track of which buttons are held for channel pressure. Any
+	// pressure change not yet applied is no longer wanted once released.
+	// Releases of buttons that were pressed on another page are ignored
+	const bool was_held = button->held;
+	button->held = pressure > 0;
+	if (!button->held && button->pressure_pending)
+	{
+		button->pressure_pending = false;
+		device->pressure_pending_count--;
+	}
 
-	// Set all the addresses
-	size_t offset = 7;
-	for (size_t row = 1; row <= device->rows; row++)
+	// If any trigger has cue list controls enabled, check for a global
+	// button first
+	if (target.global_button != NULL)
 	{
-		for (size_t column = 1; column <= device->columns; column++)
+		if (pressure > 0)
 		{
-			LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
+			if (time - button->last_press_time >= LAUNCHPAD_GLOBAL_BUTTON_LOCKOUT_MS * NANOSECS_PER_MILLISEC)
+			{
+				const stack_time_t dispatch_time = stack_get_clock_time();
+				stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_DISPATCH, dispatch_time - parse_time);
+				button->last_press_time = time;
+				stack_launchpad_trigger_midi_set_color(device, column, row, 0, 0, 0, time);
+
+				// The window is looked up on the UI thread when the action
+				// is run
+				StackLaunchpadTrigger *trigger = table->cue_list_triggers.front();
+				const size_t global_index = target.global_button - table->global_buttons;
+				if (global_index != GLOBAL_BUTTON_INDEX_STOP_ALL)
+				{
+					stack_launchpad_trigger_queue_action(LAUNCHPAD_ACTION_COMMAND, trigger, global_button_commands[global_index], 0, time);
+				}
+				else
+				{
+					stack_launchpad_trigger_queue_action(LAUNCHPAD_ACTION_STOP_ALL, trigger, LAUNCHPAD_COMMAND_GO, 0, time);
+				}
+				stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_ENQUEUE, stack_get_clock_time() - dispatch_time);
+			}
 
-			output[offset + 0] = 0x03;
-			output[offset + 1] = stack_launchpad_trigger_col_row_to_address(column, row);
-			output[offset + 2] = button->r / 2;
-			output[offset + 3] = button->g / 2;
-			output[offset + 4] = button->b / 2;
-			offset += 5;
+			// Global buttons take precedence over any other triggers
+			return;
+		}
+		else
+		{
+			stack_launchpad_trigger_midi_restore(device, column, row);
 		}
 	}
-	output[412] = MIDI_SYSEX_END;
 
-	// Send the event
-	if (device->ready)
+	// Process the triggers for this button (if there are any)
+	const LaunchpadPage *page = target.page;
+	const LaunchpadTriggerVector &triggers = page->button_triggers[index];
+	if (triggers.size() == 0 || (pressure == 0 && !was_held))
+	{
+		return;
+	}
+	const LaunchpadButtonPolicy *policy = &page->button_policies[index];
+
+	if (pressure > 0)
+	{
+		// To make it clear the button press is registered, turn off when
+		// pressed and restore when released
+		stack_launchpad_trigger_midi_set_color(device, column, row, 0, 0, 0, time);
+
+		button->velocity = pressure;
+		if (time - button->last_press_time >= policy->interval)
+		{
+			const stack_time_t dispatch_time = stack_get_clock_time();
+			stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_DISPATCH, dispatch_time - parse_time);
+			stack_launchpad_trigger_fire_button(device, page, index, button, time);
+			stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_ENQUEUE, stack_get_clock_time() - dispatch_time);
+		}
+		else if (policy->queue && !button->queued)
+		{
+			// Trigger as soon as we're allowed to. Any further early presses
+			// are combined in to this one
+			stack_launchpad_trigger_set_timer(device, button, button->last_press_time + policy->interval);
+			button->queued = true;
+		}
+	}
+	else
 	{
-		snd_rawmidi_write(device->handle_out, output, 413);
-		snd_rawmidi_drain(device->handle_out);
+		stack_launchpad_trigger_midi_restore(device, column, row);
+
+		stack_launchpad_trigger_begin_actions();
+		for (auto trigger : triggers)
+		{
+			if (!trigger->on_pressed && stack_launchpad_trigger_in_velocity_zone(trigger, button->velocity))
+			{
+				stack_launchpad_trigger_queue_action(LAUNCHPAD_ACTION_TRIGGER, trigger, LAUNCHPAD_COMMAND_GO, 0, time);
+			}
+		}
+		stack_launchpad_trigger_end_actions();
+
+		// Stop repeating, but leave any queued press to happen
+		if (button->timer_time != 0 && !button->queued)
+		{
+			stack_launchpad_trigger_set_timer(device, button, 0);
+		}
 	}
 }
 
-// Sets all the colors in the grid to black
-static void stack_launchpad_trigger_midi_all_off(LaunchpadDevice *device)
+// Records the latest pressure on a button. This is applied to the cues later
+// by stack_launchpad_trigger_flush_pressure()
+static void stack_launchpad_trigger_set_pressure(LaunchpadDevice *device, LaunchpadButton *button, uint8_t pressure)
 {
-	// Set all the colors in our local grid
-	for (size_t row = 1; row <= device->rows; row++)
+	// Pressure falls to zero just before a button is released, which we don't
+	// want to apply as it would silence the cue
+	if (!button->held || pressure == 0)
 	{
-		for (size_t column = 1; column <= device->columns; column++)
-		{
-			LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
-			button->r = 0;
-			button->g = 0;
-			button->b = 0;
-		}
+		return;
 	}
 
-	// Send all the updates in one message
-	stack_launchpad_trigger_midi_refresh_colors(device);
+	button->pressure = pressure;
+	if (!button->pressure_pending)
+	{
+		button->pressure_pending = true;
+		device->pressure_pending_count++;
+	}
 }
 
-// Updates the buttons array with the current colours for all triggers
-static void stack_launchpad_trigger_update_buttons(LaunchpadDevice *device)
+// Processes polyphonic aftertouch (pressure on a single button)
+static void stack_launchpad_trigger_process_pressure(LaunchpadDevice *device, uint8_t address, uint8_t pressure)
 {
-	// Reset
-	for (size_t row = 1; row <= device->rows; row++)
+	uint8_t column = 0, row = 0;
+	if (!device->profile->address_to_col_row(address, &column, &row))
 	{
-		for (size_t column = 1; column <= device->columns; column++)
-		{
-			LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
-			button->r = 0;
-			button->g = 0;
-			button->b = 0;
-			button->usage_count = 0;
-		}
+		return;
+	}
+	LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
+	if (button != NULL)
+	{
+		stack_launchpad_trigger_set_pressure(device, button, pressure);
 	}
+}
 
-	// Set the buttons for active triggers
-	for (auto trigger : trigger_list)
+// Processes channel pressure, which applies to every button that is held
+static void stack_launchpad_trigger_process_channel_pressure(LaunchpadDevice *device, uint8_t pressure)
+{
+	for (size_t i = 0; i < (size_t)device->rows * device->columns; i++)
 	{
-		LaunchpadButton *button = stack_launchpad_trigger_get_button(device, trigger->column, trigger->row);
-		button->usage_count++;
+		stack_launchpad_trigger_set_pressure(device, &device->buttons[i], pressure);
+	}
+}
 
-		stack_launchpad_trigger_midi_set_color(device, trigger->column, trigger->row, trigger->r, trigger->g, trigger->b);
+// Applies the latest pressure of any buttons that have changed to the cues of
+// their triggers, so long as we've not done so within the last
+// LAUNCHPAD_PRESSURE_INTERVAL_MS
+static void stack_launchpad_trigger_flush_pressure(LaunchpadDevice *device, const LaunchpadDispatchTable *table, stack_time_t time)
+{
+	if (device->pressure_pending_count == 0 || time - device->last_pressure_time < LAUNCHPAD_PRESSURE_INTERVAL_MS * NANOSECS_PER_MILLISEC)
+	{
+		return;
+	}
+	device->last_pressure_time = time;
 
-		if (trigger->use_for_cue_list)
+	const LaunchpadPage *page = stack_launchpad_trigger_get_shown_page(device, table);
+	for (uint8_t row = 1; row <= device->rows; row++)
+	{
+		for (uint8_t column = 1; column <= device->columns; column++)
 		{
-			// Add all our global buttons
-			for (size_t i = 0; i < GLOBAL_BUTTON_COUNT; i++)
+			LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
+			if (!button->pressure_pending)
+			{
+				continue;
+			}
+			button->pressure_pending = false;
+
+			for (auto trigger : page->button_triggers[stack_launchpad_trigger_button_index(column, row)])
 			{
-				stack_launchpad_trigger_add_button(device,
-					global_buttons[i].column,
-					global_buttons[i].row,
-					global_buttons[i].r,
-					global_buttons[i].g,
-					global_buttons[i].b);
+				if (trigger->pressure_curve != LAUNCHPAD_PRESSURE_CURVE_NONE)
+				{
+					stack_launchpad_trigger_queue_action(LAUNCHPAD_ACTION_PRESSURE, trigger, LAUNCHPAD_COMMAND_GO, button->pressure, time);
+				}
 			}
 		}
 	}
+	device->pressure_pending_count = 0;
 }
 
-static LaunchpadDevice *stack_launchpad_trigger_get_device(bool create)
+// Opens an ALSA sequencer client subscribed to the system announce port, so
+// that we get told when new MIDI devices appear. Returns NULL if the sequencer
+// isn't available
+static snd_seq_t *stack_launchpad_trigger_open_announce(struct pollfd *poll_fd)
 {
-	static LaunchpadDevice device;
-	static bool initialised = false;
-	static bool shown_missing_error = false;
-
-	// Lock whilst we set up the device just so there's no chance of a second
-	// device being created
-	list_mutex.lock();
-
-	if (!initialised)
+	snd_seq_t *seq = NULL;
+	if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK) < 0)
 	{
-		device.handle_in = NULL;
-		device.handle_out = NULL;
-		device.ready = false;
-		initialised = true;
-		device.rows = 9;
-		device.columns = 9;
-		device.buttons = new LaunchpadButton[device.rows * device.columns];
-		memset(device.buttons, 0, device.columns * device.rows * sizeof(LaunchpadButton));
+		stack_log("stack_launchpad_trigger_open_announce(): Failed to open sequencer, will poll for devices\n");
+		return NULL;
 	}
+	snd_seq_set_client_name(seq, "Stack Launchpad Trigger");
 
-	// If we already have a device, return it
-	if (device.ready)
+	int port = snd_seq_create_simple_port(seq, "Announce", SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE, SND_SEQ_PORT_TYPE_APPLICATION);
+	if (port < 0 || snd_seq_connect_from(seq, port, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE) < 0 || snd_seq_poll_descriptors(seq, poll_fd, 1, POLLIN) != 1)
 	{
-		list_mutex.unlock();
-		return &device;
+		stack_log("stack_launchpad_trigger_open_announce(): Failed to subscribe to announcements, will poll for devices\n");
+		snd_seq_close(seq);
+		return NULL;
 	}
 
-	// If we've not get a ready device, but we're not creating one, return NULL
-	if (!create)
-	{
-		list_mutex.unlock();
-		return &device;
-	}
+	return seq;
+}
 
-	// Find the address of the Launchpad device
-	char device_address[32];
-	if (!stack_launchpad_trigger_get_device_address(device_address, sizeof(device_address)))
+// Consumes all the pending sequencer announcements. Returns true if any of
+// them were for a new client or port (which might be a Launchpad)
+static bool stack_launchpad_trigger_read_announce(snd_seq_t *seq)
+{
+	bool device_added = false;
+	snd_seq_event_t *event = NULL;
+	while (snd_seq_event_input(seq, &event) >= 0)
 	{
-		// Only show this error once
-		if (!shown_missing_error)
+		if (event->type == SND_SEQ_EVENT_CLIENT_START || event->type == SND_SEQ_EVENT_PORT_START)
 		{
-			stack_log("stack_launchpad_trigger_get_device(): No Launchpad MIDI device found!\n");
-			shown_missing_error = true;
+			device_added = true;
 		}
-		list_mutex.unlock();
-		return &device;
 	}
 
-	// Open the MIDI in/out devices
-	if (!device.ready)
+	return device_added;
+}
+
+// Feeds bytes read from a device through the parser and processes the
+// messages. The time is when the bytes were received, and read_time is when we
+// read them. The caller should be using the given dispatch table
+static void stack_launchpad_trigger_process_bytes(LaunchpadDevice *device, const LaunchpadDispatchTable *table, const unsigned char *data, size_t length, stack_time_t time, stack_time_t read_time)
+{
+	// The parser keeps hold of any partial message until the next read
+	for (size_t i = 0; i < length; i++)
 	{
-		stack_log("stack_launchpad_trigger_get_device(): Opening new device\n");
-		int result = snd_rawmidi_open(&device.handle_in, &device.handle_out, device_address, 0);
-		if (result > 0)
+		LaunchpadMidiMessage message;
+		if (!stack_launchpad_trigger_parse_byte(&device->parser, data[i], &message))
 		{
-			stack_log("stack_launchpad_trigger_get_device(): Failed to open MIDI devices: %d\n", result);
-			list_mutex.unlock();
-			return &device;
+			continue;
 		}
 
-		int count = snd_rawmidi_poll_descriptors(device.handle_in, &device.poll_fds, 1);
-		if (count == 0)
+		// Button presses are either a note on or a controller change. A note
+		// off is the same as a note on with zero pressure, but isn't counted in
+		// the parse latency
+		uint8_t pressure;
+		if (stack_launchpad_trigger_button_pressure(&message, &pressure))
 		{
-			stack_log("stack_launchpad_trigger_get_device(): Failed to get MIDI poll descriptors\n");
-			snd_rawmidi_close(device.handle_in);
-			snd_rawmidi_close(device.handle_out);
-			list_mutex.unlock();
-			return &device;
+			const stack_time_t parse_time = stack_get_clock_time();
+			if (message.status != MIDI_NOTE_OFF)
+			{
+				stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_PARSE, parse_time - read_time);
+			}
+			stack_launchpad_trigger_process_button(device, table, message.data[0], pressure, time, parse_time);
+			continue;
 		}
 
-		shown_missing_error = false;
-		device.ready = true;
-
-		// Ensure all the LEDs are set correctly
-		stack_launchpad_trigger_update_buttons(&device);
+		switch (message.status)
+		{
+			case MIDI_POLY_AFTERTOUCH:
+				stack_launchpad_trigger_process_pressure(device, message.data[0], message.data[1]);
+				break;
+			case MIDI_CHANNEL_PRESSURE:
+				stack_launchpad_trigger_process_channel_pressure(device, message.data[0]);
+				break;
+		}
 	}
-
-	// Unlock again now that we're ready
-	list_mutex.unlock();
-
-	return &device;
 }
 
-static void stack_launchpad_trigger_close_device(LaunchpadDevice *device)
+// Reads all the available data from a device, and processes the messages
+static void stack_launchpad_trigger_read_device(LaunchpadDevice *device)
 {
-	if (device == NULL)
+	unsigned char buf[LAUNCHPAD_READ_BUFFER_SIZE];
+	struct timespec timestamp = {0, 0};
+	ssize_t result = midi_backend->read(device, buf, sizeof(buf), &timestamp);
+	if (result < 0)
 	{
+		// If we fail to read, close the device so that we can retry
+		stack_log("stack_launchpad_trigger_read_device(): Failed to read from MIDI device %s: %d\n", device->id, (int)result);
+		stack_launchpad_trigger_close_device(device);
 		return;
 	}
 
-	if (device->handle_out != NULL)
+	// All the messages in this read share the same timestamp. If the backend
+	// gave us one, work out how long ago it was on its (monotonic) clock, as that may
+	// not be the clock we use
+	const stack_time_t read_time = stack_get_clock_time();
+	stack_time_t time = read_time;
+	if (timestamp.tv_sec != 0 || timestamp.tv_nsec != 0)
 	{
-		// Clear all the buttons at once
-		stack_launchpad_trigger_midi_all_off(device);
-
-		snd_rawmidi_drain(device->handle_out);
-		snd_rawmidi_close(device->handle_out);
-		stack_log("stack_launchpad_trigger_close_device(): MIDI Out closed\n");
-		device->handle_out = NULL;
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		const stack_time_t delay = (stack_time_t)(now.tv_sec - timestamp.tv_sec) * NANOSECS_PER_SEC + (now.tv_nsec - timestamp.tv_nsec);
+		if (delay >= 0)
+		{
+			time = read_time - delay;
+			stack_launchpad_trigger_record_latency(LAUNCHPAD_LATENCY_READ, delay);
+		}
 	}
 
-	device->ready = false;
+	stack_launchpad_trigger_capture(device, LAUNCHPAD_CAPTURE_IN, buf, result, time);
 
-	if (device->handle_in != NULL)
+	// Let writers know that we're using the dispatch table, and get it. We
+	// use the same table for everything in this read
+	dispatch_generation++;
+	const LaunchpadDispatchTable *table = device->dispatch.load();
+
+	stack_launchpad_trigger_process_bytes(device, table, buf, result, time, read_time);
+
+	// A full read means that the device is sending faster than we read
+	if ((size_t)result == sizeof(buf))
 	{
-		snd_rawmidi_close(device->handle_in);
-		stack_log("stack_launchpad_trigger_close_device(): MIDI In closed\n");
-		device->handle_in = NULL;
+		device->stats.full_reads.fetch_add(1, std::memory_order_relaxed);
 	}
+	if (device->parser.incomplete_count > 0)
+	{
+		device->stats.incomplete_messages.fetch_add(device->parser.incomplete_count, std::memory_order_relaxed);
+		device->parser.incomplete_count = 0;
+	}
+
+	// Fire any button timers that are due, and apply any pressure changes (if
+	// it's time to)
+	stack_launchpad_trigger_process_timers(device, table, read_time);
+	stack_launchpad_trigger_flush_pressure(device, table, read_time);
+
+	// We're done with the dispatch table
+	dispatch_generation++;
+}
 
-	// We only ever initialise the button array once, so don't delete it
-	/*if (device->buttons != NULL)
+// Touches and locks (or unlocks) the part of the stack below the caller, which
+// is where the frames of the functions that the thread calls will be. This
+// must be called from near the top level of the MIDI thread
+static bool __attribute__((noinline)) stack_launchpad_trigger_lock_stack(bool lock)
+{
+	volatile unsigned char stack[LAUNCHPAD_LOCKED_STACK_SIZE];
+	const long page_size = sysconf(_SC_PAGESIZE);
+	for (size_t i = 0; i < sizeof(stack); i += (page_size > 0 ? page_size : 4096))
 	{
-		delete [] device->buttons;
-		device->buttons = NULL;
+		stack[i] = 0;
 	}
-	device->rows = 0;
-	device->columns = 0;*/
+
+	return stack_launchpad_trigger_lock_region((const void*)stack, sizeof(stack), lock);
 }
 
-static void stack_launchpad_trigger_run_action(StackLaunchpadTrigger *trigger)
+// Locks (or unlocks) the memory that the MIDI thread touches whilst
+// dispatching. We do this rather than locking the whole process, as that is
+// shared with the rest of Stack. Only called by the MIDI thread
+static void stack_launchpad_trigger_lock_thread_memory(bool lock)
 {
-	// Get the cue and the action
-	StackCue *cue = STACK_TRIGGER(trigger)->cue;
-	StackTriggerAction action = stack_trigger_get_action(STACK_TRIGGER(trigger));
+	if (lock == thread_memory_locked)
+	{
+		return;
+	}
 
-	// Run the correct action
-	stack_cue_list_lock(cue->parent);
-	switch (action)
+	bool locked = stack_launchpad_trigger_lock_stack(lock);
+	locked = stack_launchpad_trigger_lock_region(&action_queue, sizeof(action_queue), lock) && locked;
+	device_mutex.lock();
+	for (auto device : devices)
 	{
-		case STACK_TRIGGER_ACTION_STOP:
-			stack_cue_stop(cue);
-			break;
-		case STACK_TRIGGER_ACTION_PAUSE:
-			stack_cue_pause(cue);
-			break;
-		case STACK_TRIGGER_ACTION_PLAY:
-			stack_cue_play(cue);
-			break;
+		locked = stack_launchpad_trigger_lock_device(device, lock) && locked;
+	}
+	thread_memory_locked = lock;
+	device_mutex.unlock();
+
+	if (lock && !locked)
+	{
+		stack_log("stack_launchpad_trigger_lock_thread_memory(): Not all memory could be locked, and may be swapped out\n");
+	}
+	else if (lock)
+	{
+		stack_log("stack_launchpad_trigger_lock_thread_memory(): Memory locked\n");
 	}
-	stack_cue_list_unlock(cue->parent);
 }
 
-typedef struct SimKeyData
+// Applies the scheduling settings to the MIDI thread, falling back to normal
+// scheduling for anything the system doesn't allow. Only called by the MIDI
+// thread
+static void stack_launchpad_trigger_apply_thread_settings()
 {
-	GdkEvent *event;
-	GObject *widget;
-} SimKeyData;
+	// Priority
+	struct sched_param param = {0};
+	bool realtime = false;
+	if (thread_settings.realtime)
+	{
+		param.sched_priority = LAUNCHPAD_REALTIME_PRIORITY;
+		int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (result == 0)
+		{
+			stack_log("stack_launchpad_trigger_apply_thread_settings(): Running with real-time priority %d\n", LAUNCHPAD_REALTIME_PRIORITY);
+			realtime = true;
+		}
+		else
+		{
+			stack_log("stack_launchpad_trigger_apply_thread_settings(): Failed to set real-time priority (%s), running with normal priority\n", strerror(result));
+			param.sched_priority = 0;
+			pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+		}
+	}
+	else
+	{
+		pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+	}
 
-static gboolean stack_launchpad_trigger_fake_keypress(gpointer f)
-{
-	gboolean result;
-	g_signal_emit_by_name(((SimKeyData*)f)->widget, "key-press-event", ((SimKeyData*)f)->event, &result);
-	delete (SimKeyData*)f;
-	return G_SOURCE_REMOVE;
+	// Affinity. Running on any CPU means any that the process is allowed to
+	cpu_set_t process_cpus;
+	CPU_ZERO(&process_cpus);
+	if (sched_getaffinity(getpid(), sizeof(process_cpus), &process_cpus) != 0)
+	{
+		for (int i = 0; i < CPU_SETSIZE; i++)
+		{
+			CPU_SET(i, &process_cpus);
+		}
+	}
+	const int cpu = thread_settings.cpu;
+	bool pinned = false;
+	if (cpu >= 0 && cpu < CPU_SETSIZE)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (result == 0)
+		{
+			stack_log("stack_launchpad_trigger_apply_thread_settings(): Pinned to CPU %d\n", cpu);
+			pinned = true;
+		}
+		else
+		{
+			stack_log("stack_launchpad_trigger_apply_thread_settings(): Failed to pin to CPU %d (%s), running on any CPU\n", cpu, strerror(result));
+		}
+	}
+	if (!pinned)
+	{
+		pthread_setaffinity_np(pthread_self(), sizeof(process_cpus), &process_cpus);
+	}
+
+	stack_launchpad_trigger_lock_thread_memory(thread_settings.lock_memory);
+
+	thread_status.realtime = realtime;
+	thread_status.cpu = pinned ? cpu : -1;
+	thread_status.memory_locked = thread_memory_locked;
 }
 
-static void stack_launchpad_trigger_simulate_keypress(StackAppWindow *window, guint key)
+// Changes the scheduling settings of the MIDI thread, which applies them the
+// next time that it wakes up
+static void stack_launchpad_trigger_set_thread_settings(bool realtime, int cpu, bool lock_memory)
 {
-	GdkEvent *event = gdk_event_new(GDK_KEY_PRESS);
-	event->key.window = g_object_ref(window->sclw->window);
-	event->key.send_event = TRUE;
-	event->key.time = 0;
-	event->key.state = 0;
-	event->key.hardware_keycode = 0;
-	event->key.group = 0;
-	event->key.is_modifier = 0;
-	event->key.length = 0;
-	event->key.keyval = key;
-	event->key.string = g_strdup("");
-
-	SimKeyData *data = new SimKeyData;
-	data->event = event;
-	data->widget = G_OBJECT(window->sclw);
-	gdk_threads_add_idle(stack_launchpad_trigger_fake_keypress, data);
+	thread_settings.realtime = realtime;
+	thread_settings.cpu = cpu;
+	thread_settings.lock_memory = lock_memory;
+	thread_settings.changed = true;
+	stack_launchpad_trigger_wake_thread();
 }
 
 static void stack_launchpad_trigger_thread(void *user_data)
 {
-	int result = 0;
-	LaunchpadDevice *device = NULL;
+	thread_settings.changed = false;
+	stack_launchpad_trigger_apply_thread_settings();
+
+	// Listen for new devices being plugged in
+	struct pollfd seq_poll_fd = {-1, 0, 0};
+	snd_seq_t *seq = stack_launchpad_trigger_open_announce(&seq_poll_fd);
+
+	// Our poll set is the wakeup eventfd, the sequencer announcements, and
+	// then each of the open devices
+	struct pollfd poll_fds[LAUNCHPAD_MAX_DEVICES + 2];
+	LaunchpadDevice *poll_devices[LAUNCHPAD_MAX_DEVICES];
+	bool scan = true;
+	stack_time_t next_scan_time = 0;
+	const stack_time_t rescan_interval = (seq != NULL ? DEVICE_RESCAN_INTERVAL_ANNOUNCE_MS : DEVICE_RESCAN_INTERVAL_MS) * NANOSECS_PER_MILLISEC;
 
 	// Keep the thread about whilst we have triggers to process
-	while (trigger_list.size() > 0)
+	while (trigger_count > 0)
 	{
-		while (trigger_list.size() > 0 && (device == NULL || !device->ready))
-		{
-			device = stack_launchpad_trigger_get_device(true);
-			if (device == NULL || !device->ready)
-			{
-				std::this_thread::sleep_for(std::chrono::seconds(1));
-			}
-		}
-
-		// Read from the MIDI device
-		int poll_result = poll(&device->poll_fds, 1, 100);
-		if (poll_result < 0)
+		if (thread_settings.changed.exchange(false))
 		{
-			stack_log("stack_launchpad_trigger_thread(): Poll failed: %d\n", poll_result);
-			continue;
-		}
-		else if (poll_result == 0)
-		{
-			// Nothing was ready
-			continue;
+			stack_launchpad_trigger_apply_thread_settings();
 		}
 
-		// Device could have returned from the poll after it was closed
-		if (!device->ready)
+		if (scan)
 		{
-			continue;
+			stack_launchpad_trigger_open_devices();
+			scan = false;
+			next_scan_time = stack_get_clock_time() + rescan_interval;
 		}
 
-		unsigned char buf[32];
-		result = snd_rawmidi_read(device->handle_in, buf, sizeof(buf));
-		if (result < 0)
+		// Build up the set of devices to poll. If we've not got any devices,
+		// or one of them has gone away, keep rescanning occasionally in case
+		// we miss the announcement (or don't get them at all)
+		size_t device_count = 0;
+		device_mutex.lock();
+		bool missing = devices.size() == 0;
+		for (auto device : devices)
 		{
-			// If we fail to read, close the device so that we can retry
-			stack_log("stack_launchpad_trigger_thread(): Failed to read from MIDI device: %d\n", result);
-			stack_launchpad_trigger_close_device(device);
-			continue;
+			if (device->ready)
+			{
+				poll_devices[device_count] = device;
+				poll_fds[device_count + 2] = device->poll_fds;
+				poll_fds[device_count + 2].revents = 0;
+				device_count++;
+			}
+			else
+			{
+				missing = true;
+			}
 		}
+		device_mutex.unlock();
 
-		// Iterate over all the bytes in the message
-		for (size_t i = 0; i < result; i++)
+		// Wake up in time for the next rescan, for any pressure changes that
+		// are being held back to be applied, and for any button timers
+		stack_time_t now = stack_get_clock_time();
+		stack_time_t wake_time = missing ? next_scan_time : -1;
+		for (size_t i = 0; i < device_count; i++)
 		{
-			const unsigned char event = buf[i];
-			const unsigned char address = buf[i + 1];
-			const unsigned char pressure = buf[i + 2];
-			unsigned char r = 127, g = 0, b = 0, column = 0, row = 0;
-
-			// All MIDI messages start with a byte whose MSB is 1, so sync up to that
-			if (event & 0x80 != 0)
+			if (poll_devices[i]->pressure_pending_count > 0)
 			{
-				continue;
+				stack_time_t pressure_time = poll_devices[i]->last_pressure_time + LAUNCHPAD_PRESSURE_INTERVAL_MS * NANOSECS_PER_MILLISEC;
+				if (wake_time < 0 || pressure_time < wake_time)
+				{
+					wake_time = pressure_time;
+				}
 			}
 
-			// Button presses are either a note on or a controller change
-			if (event != MIDI_NOTE_ON && event != MIDI_CONTROL_CHANGE)
+			stack_time_t timer_time = stack_launchpad_trigger_next_timer(poll_devices[i]);
+			if (timer_time >= 0 && (wake_time < 0 || timer_time < wake_time))
 			{
-				continue;
+				wake_time = timer_time;
 			}
+		}
+		int timeout = -1;
+		if (wake_time >= 0)
+		{
+			timeout = wake_time > now ? (int)((wake_time - now + NANOSECS_PER_MILLISEC - 1) / NANOSECS_PER_MILLISEC) : 0;
+		}
 
-			// Get the button
-			stack_launchpad_trigger_address_to_col_row(address, &column, &row);
-			LaunchpadButton *button = stack_launchpad_trigger_get_button(device, column, row);
+		poll_fds[0].fd = wakeup_fd;
+		poll_fds[0].events = POLLIN;
+		poll_fds[0].revents = 0;
+		poll_fds[1] = seq_poll_fd;
+		poll_fds[1].revents = 0;
 
-			// Search for the trigger for this button (if there is one)
-			list_mutex.lock();
-			for (auto trigger : trigger_list)
+		// Wait for data from the MIDI devices, or for something to wake us up
+		int poll_result = poll(poll_fds, device_count + 2, timeout);
+		if (poll_result < 0)
+		{
+			if (errno != EINTR)
 			{
-				if (trigger->use_for_cue_list)
-				{
-					uint8_t r = 0, g = 0, b = 0;
-
-					uint32_t keyval = 0;
-					for (size_t i = 0; i < GLOBAL_BUTTON_COUNT; i++)
-					{
-						if (row == global_buttons[i].row && column == global_buttons[i].column)
-						{
-							keyval = global_buttons[i].keymap;
-							r = global_buttons[i].r;
-							g = global_buttons[i].g;
-							b = global_buttons[i].b;
-						}
-					}
+				stack_log("stack_launchpad_trigger_thread(): Poll failed: %d\n", errno);
+			}
+			continue;
+		}
 
-					if (keyval > 0)
-					{
-						if (pressure > 0)
-						{
-							if (stack_get_clock_time() - button->last_press_time > 1e3)
-							{
-								button->last_press_time = stack_get_clock_time();
-								stack_launchpad_trigger_midi_set_color(device, column, row, 0, 0, 0);
-
-								StackAppWindow *window = saw_get_window_for_cue(STACK_TRIGGER(trigger)->cue);
-								if (keyval != GDK_KEY_Escape)
-								{
-									stack_launchpad_trigger_simulate_keypress(window, keyval);
-								}
-								else
-								{
-									// We have a function for this one
-									stack_cue_list_stop_all(trigger->super.cue->parent);
-								}
-							}
-							device->buttons[row * device->rows + column].last_press_time = stack_get_clock_time();
-							break;
-						}
-						else
-						{
-							stack_launchpad_trigger_midi_set_color(device, column, row, r, g, b);
-						}
-					}
-				}
-				if (trigger->row == row && trigger->column == column)
-				{
-					bool debounced = false;
+		if (poll_fds[0].revents & POLLIN)
+		{
+			stack_launchpad_trigger_clear_wakeup();
+		}
 
-					// To make it clear the button press is registered, turn off when pressed
-					// and restore when released
-					if (pressure > 0)
-					{
-						if (stack_get_clock_time() - button->last_press_time > 1e3)
-						{
-							button->last_press_time = stack_get_clock_time();
-							stack_launchpad_trigger_midi_set_color(device, column, row, 0, 0, 0);
-						}
-						else
-						{
-							debounced = true;
-						}
-					}
-					else
-					{
-						stack_launchpad_trigger_midi_set_color(device, column, row, trigger->r, trigger->g, trigger->b);
-					}
+		if ((poll_fds[1].revents & POLLIN) && stack_launchpad_trigger_read_announce(seq))
+		{
+			scan = true;
+		}
 
-					if ((!debounced && pressure > 0 && trigger->on_pressed) || (pressure == 0 && !trigger->on_pressed))
-					{
-						stack_launchpad_trigger_run_action(trigger);
-					}
-				}
+		for (size_t i = 0; i < device_count; i++)
+		{
+			// Device could have returned from the poll after it was closed
+			LaunchpadDevice *device = poll_devices[i];
+			if (device->ready && (poll_fds[i + 2].revents & (POLLIN | POLLERR | POLLHUP)))
+			{
+				stack_launchpad_trigger_read_device(device);
+			}
+		}
+
+		// Fire any button timers and apply any pressure changes that we held
+		// back that are now due
+		now = stack_get_clock_time();
+		for (size_t i = 0; i < device_count; i++)
+		{
+			LaunchpadDevice *device = poll_devices[i];
+			if (device->ready && (device->timer_count > 0 || device->pressure_pending_count > 0))
+			{
+				dispatch_generation++;
+				const LaunchpadDispatchTable *table = device->dispatch.load();
+				stack_launchpad_trigger_process_timers(device, table, now);
+				stack_launchpad_trigger_flush_pressure(device, table, now);
+				dispatch_generation++;
 			}
-			list_mutex.unlock();
+		}
+
+		// If we've been waiting long enough, go and look for devices again
+		if (missing && now >= next_scan_time)
+		{
+			scan = true;
 		}
 	}
 
 	// Tidy up
-	stack_launchpad_trigger_close_device(device);
+	device_mutex.lock();
+	std::vector<LaunchpadDevice*> close_devices = devices;
+	device_mutex.unlock();
+	for (auto device : close_devices)
+	{
+		stack_launchpad_trigger_close_device(device);
+	}
+	stack_launchpad_trigger_lock_thread_memory(false);
+	if (seq != NULL)
+	{
+		snd_seq_close(seq);
+	}
 
 	// Note the exit of the thread
 	stack_log("stack_launchpad_trigger_thread(): Terminating\n");
@@ -693,6 +3520,95 @@ static void stack_launchpad_trigger_thread(void *user_data)
 ////////////////////////////////////////////////////////////////////////////////
 // CREATION AND DESTRUCTION
 
+// Main loop callback that runs once the UI thread is idle after triggers have
+// been created, which for a show is once Stack has finished loading all of it.
+// Rather than rebuilding the dispatch tables and relighting the devices for
+// every trigger as it's loaded, the staged triggers are all added in one go
+static gboolean stack_launchpad_trigger_finish_load(gpointer user_data)
+{
+	std::lock_guard<std::mutex> lock(list_mutex);
+	load_source = 0;
+
+	size_t staged_count = 0;
+	for (auto trigger : trigger_list)
+	{
+		if (trigger->staged)
+		{
+			trigger->staged = false;
+			staged_count++;
+		}
+	}
+
+	// This rebuilds each dispatch table once and sends each device its whole
+	// grid in one message
+	if (staged_count > 0)
+	{
+		stack_log("stack_launchpad_trigger_finish_load(): Adding %zu triggers\n", staged_count);
+		stack_launchpad_trigger_update_all_buttons();
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+// Appends a string to the event text being built at text, stopping at end.
+// Returns where the text now ends
+static char *stack_launchpad_trigger_append_text(char *text, char *end, const char *value)
+{
+	while (text < end && *value != '\0')
+	{
+		*text++ = *value++;
+	}
+	return text;
+}
+
+// Appends a number to the event text being built at text, stopping at end.
+// Returns where the text now ends
+static char *stack_launchpad_trigger_append_number(char *text, char *end, unsigned int value)
+{
+	const std::to_chars_result result = std::to_chars(text, end, value);
+	return result.ec == std::errc() ? result.ptr : text;
+}
+
+// Rebuilds the event text of a trigger. This must be called whenever the
+// device, button, page or velocities of the trigger change, so that the cue
+// list can redraw without formatting anything
+static void stack_launchpad_trigger_update_event_text(StackLaunchpadTrigger *trigger)
+{
+	char *text = trigger->event_text;
+	char *const end = &trigger->event_text[sizeof(trigger->event_text) - 1];
+
+	if (trigger->device_id != NULL && trigger->device_id[0] != '\0')
+	{
+		text = stack_launchpad_trigger_append_text(text, end, trigger->device_id);
+		text = stack_launchpad_trigger_append_text(text, end, " ");
+	}
+
+	// Only mention the page if the trigger isn't on the first one
+	if (trigger->page > 1)
+	{
+		text = stack_launchpad_trigger_append_text(text, end, "Page ");
+		text = stack_launchpad_trigger_append_number(text, end, trigger->page);
+		text = stack_launchpad_trigger_append_text(text, end, " ");
+	}
+
+	// Likewise the velocities, if the trigger doesn't fire for all of them
+	if (trigger->velocity_min > LAUNCHPAD_VELOCITY_MIN || trigger->velocity_max < LAUNCHPAD_VELOCITY_MAX)
+	{
+		text = stack_launchpad_trigger_append_text(text, end, "Vel ");
+		text = stack_launchpad_trigger_append_number(text, end, trigger->velocity_min);
+		text = stack_launchpad_trigger_append_text(text, end, "-");
+		text = stack_launchpad_trigger_append_number(text, end, trigger->velocity_max);
+		text = stack_launchpad_trigger_append_text(text, end, " ");
+	}
+
+	text = stack_launchpad_trigger_append_text(text, end, "Button (");
+	text = stack_launchpad_trigger_append_number(text, end, trigger->column);
+	text = stack_launchpad_trigger_append_text(text, end, ", ");
+	text = stack_launchpad_trigger_append_number(text, end, trigger->row);
+	text = stack_launchpad_trigger_append_text(text, end, ")");
+	*text = '\0';
+}
+
 /// Creates a key trigger
 StackTrigger* stack_launchpad_trigger_create(StackCue *cue)
 {
@@ -707,18 +3623,60 @@ StackTrigger* stack_launchpad_trigger_create(StackCue *cue)
 
 	// Initial setup
 	trigger->description = strdup("");
-	trigger->event_text[0] = '\0';
+	trigger->device_id = strdup("");
 	trigger->r = 0;
 	trigger->g = 0;
 	trigger->b = 0;
 	trigger->column = 0;
 	trigger->row = 0;
+	trigger->page = 1;
 	trigger->on_pressed = true;
 	trigger->use_for_cue_list = false;
-
-	// Add us to the list of triggers
+	trigger->pressure_curve = LAUNCHPAD_PRESSURE_CURVE_NONE;
+	trigger->debounce_ms = LAUNCHPAD_DEFAULT_DEBOUNCE_MS;
+	trigger->repeat_mode = LAUNCHPAD_REPEAT_IGNORE;
+	trigger->hold_repeat = false;
+	trigger->velocity_min = LAUNCHPAD_VELOCITY_MIN;
+	trigger->velocity_max = LAUNCHPAD_VELOCITY_MAX;
+	trigger->playback_feedback = false;
+	trigger->feedback_state = LAUNCHPAD_FEEDBACK_IDLE;
+	stack_launchpad_trigger_update_event_text(trigger);
+
+	// Add us to the list of triggers. We're staged until the UI thread is next
+	// idle, so that loading a show adds all of its triggers at once
 	list_mutex.lock();
+	trigger->staged = true;
 	trigger_list.push_back(trigger);
+	trigger_count = trigger_list.size();
+	if (load_source == 0)
+	{
+		load_source = g_idle_add(stack_launchpad_trigger_finish_load, NULL);
+	}
+
+	// Create the eventfd used to wake the thread up
+	if (wakeup_fd < 0)
+	{
+		wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (wakeup_fd < 0)
+		{
+			stack_log("stack_launchpad_trigger_create(): Failed to create eventfd: %d\n", errno);
+		}
+	}
+
+	// Create the queue that the thread sends actions to us through. This is
+	// kept for the lifetime of the plugin
+	if (action_queue.event_fd < 0)
+	{
+		action_queue.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (action_queue.event_fd < 0)
+		{
+			stack_log("stack_launchpad_trigger_create(): Failed to create action eventfd: %d\n", errno);
+		}
+		else
+		{
+			g_unix_fd_add(action_queue.event_fd, G_IO_IN, stack_launchpad_trigger_action_ready, NULL);
+		}
+	}
 
 	if (!thread_running)
 	{
@@ -733,6 +3691,20 @@ StackTrigger* stack_launchpad_trigger_create(StackCue *cue)
 		}
 
 		midi_thread = std::thread(stack_launchpad_trigger_thread, (void*)NULL);
+
+		// Start the LED thread alongside
+		if (led_thread.joinable())
+		{
+			led_thread.join();
+		}
+		led_thread_running = true;
+		led_thread = std::thread(stack_launchpad_trigger_led_thread, (void*)NULL);
+
+		// Capture alongside the MIDI thread, if we've been asked to
+		if (capture_requested && capture_filename.size() > 0)
+		{
+			stack_launchpad_trigger_start_capture();
+		}
 	}
 
 	// We're done with list actions now
@@ -745,44 +3717,65 @@ StackTrigger* stack_launchpad_trigger_create(StackCue *cue)
 void stack_launchpad_trigger_destroy(StackTrigger *trigger)
 {
 	StackLaunchpadTrigger *launchpad_trigger = STACK_LAUNCHPAD_TRIGGER(trigger);
-
-	// Get the current device (but don't create if we don't have one)
-	LaunchpadDevice *device = stack_launchpad_trigger_get_device(false);
+	stack_launchpad_trigger_watch_feedback(launchpad_trigger, false);
 
 	// Remove ourselves from the list
 	list_mutex.lock();
 	trigger_list.remove(launchpad_trigger);
+	trigger_count = trigger_list.size();
+	stack_launchpad_trigger_index_remove(launchpad_trigger);
 
-	// Mark the button as no longer in use
-	if (device != NULL && launchpad_trigger->column > 0 && launchpad_trigger->row > 0)
+	// Mark the button as no longer in use (staged triggers were never using it)
+	LaunchpadDevice *device = stack_launchpad_trigger_get_trigger_device(launchpad_trigger);
+	if (device != NULL && !launchpad_trigger->staged && launchpad_trigger->column > 0 && launchpad_trigger->row > 0)
 	{
-		stack_launchpad_trigger_remove_button(device, launchpad_trigger->column, launchpad_trigger->row);
+		stack_launchpad_trigger_remove_button(device, launchpad_trigger->page - 1, launchpad_trigger->column, launchpad_trigger->row);
 	}
 
 	// Wait for the thread to die
-	if (trigger_list.size() == 0)
+	if (trigger_count == 0)
 	{
-		stack_log("stack_launchpad_trigger_destroy(): No triggers left, closing device\n");
-
-		// Close device locks the mutex, so unlock here first
+		stack_log("stack_launchpad_trigger_destroy(): No triggers left, stopping thread\n");
 		list_mutex.unlock();
-		if (device != NULL)
-		{
-			stack_launchpad_trigger_close_device(device);
-		}
+
+		// Wake the thread up so it notices immediately. It closes the devices
+		// on its way out
+		stack_launchpad_trigger_wake_thread();
 		stack_log("stack_launchpad_trigger_destroy(): Waiting for thread\n");
 		midi_thread.join();
+
+		// Stop the LED thread
+		led_mutex.lock();
+		led_thread_running = false;
+		led_mutex.unlock();
+		led_condition.notify_one();
+		led_thread.join();
+
+		// Nothing more can be captured
+		stack_launchpad_trigger_stop_capture();
+
+		// Nor is there anything to show the state of
+		stack_launchpad_trigger_stop_feedback();
 	}
 	else
 	{
 		list_mutex.unlock();
 	}
 
+	// The thread can't queue any more actions for us now, so get rid of any
+	// that haven't been run yet
+	stack_launchpad_trigger_purge_actions(launchpad_trigger);
+
 	if (launchpad_trigger->description != NULL)
 	{
 		free(launchpad_trigger->description);
 	}
 
+	if (launchpad_trigger->device_id != NULL)
+	{
+		free(launchpad_trigger->device_id);
+	}
+
 	// Call parent destructor
 	stack_trigger_destroy_base(trigger);
 }
@@ -804,13 +3797,11 @@ const char* stack_launchpad_trigger_get_name(StackTrigger *trigger)
 	}
 }
 
-// Returns the name of the key we're triggered off
+// Returns the name of the key we're triggered off, which is rebuilt whenever
+// it changes rather than here
 const char* stack_launchpad_trigger_get_event_text(StackTrigger *trigger)
 {
-	StackLaunchpadTrigger *launchpad_trigger = STACK_LAUNCHPAD_TRIGGER(trigger);
-
-	snprintf(launchpad_trigger->event_text, sizeof(launchpad_trigger->event_text), "Button (%d, %d)", launchpad_trigger->column, launchpad_trigger->row);
-	return launchpad_trigger->event_text;
+	return STACK_LAUNCHPAD_TRIGGER(trigger)->event_text;
 }
 
 // Returns the user-specified description
@@ -819,22 +3810,48 @@ const char* stack_launchpad_trigger_get_description(StackTrigger *trigger)
 	return STACK_LAUNCHPAD_TRIGGER(trigger)->description;
 }
 
+// Returns the writer that we use for JSON that we save. This writes without
+// any indentation or newlines, and is kept for the lifetime of the plugin so
+// that we don't set up a new one each time
+static const Json::StreamWriterBuilder &stack_launchpad_trigger_json_writer()
+{
+	static const Json::StreamWriterBuilder builder = []()
+	{
+		Json::StreamWriterBuilder compact_builder;
+		compact_builder["indentation"] = "";
+		return compact_builder;
+	}();
+
+	return builder;
+}
+
 char *stack_launchpad_trigger_to_json(StackTrigger *trigger)
 {
-	Json::Value trigger_root;
 	StackLaunchpadTrigger *launchpad_trigger = STACK_LAUNCHPAD_TRIGGER(trigger);
 
-	trigger_root["description"] = launchpad_trigger->description;
-	trigger_root["row"] = launchpad_trigger->row;
-	trigger_root["column"] = launchpad_trigger->column;
-	trigger_root["r"] = launchpad_trigger->r;
-	trigger_root["g"] = launchpad_trigger->g;
-	trigger_root["b"] = launchpad_trigger->b;
-	trigger_root["on_pressed"] = launchpad_trigger->on_pressed;
-	trigger_root["use_for_cue_list"] = launchpad_trigger->use_for_cue_list;
-
-	Json::StreamWriterBuilder builder;
-	return strdup(Json::writeString(builder, trigger_root).c_str());
+	// This is called for every trigger each time a show is saved, so rather
+	// than building a Json::Value for each one we write the fields directly.
+	// Only the description and device need escaping. The fields (and their
+	// types) must match what stack_launchpad_trigger_from_json reads
+	char fields[512];
+	snprintf(fields, sizeof(fields), ",\"row\":%u,\"column\":%u,\"page\":%u,\"r\":%u,\"g\":%u,\"b\":%u,\"on_pressed\":%s,\"use_for_cue_list\":%s,\"pressure_curve\":%u,\"debounce_ms\":%u,\"repeat_mode\":%u,\"hold_repeat\":%s,\"velocity_min\":%u,\"velocity_max\":%u,\"playback_feedback\":%s}",
+		launchpad_trigger->row, launchpad_trigger->column, launchpad_trigger->page,
+		launchpad_trigger->r, launchpad_trigger->g, launchpad_trigger->b,
+		launchpad_trigger->on_pressed ? "true" : "false",
+		launchpad_trigger->use_for_cue_list ? "true" : "false",
+		(unsigned int)launchpad_trigger->pressure_curve, launchpad_trigger->debounce_ms,
+		(unsigned int)launchpad_trigger->repeat_mode,
+		launchpad_trigger->hold_repeat ? "true" : "false",
+		launchpad_trigger->velocity_min, launchpad_trigger->velocity_max,
+		launchpad_trigger->playback_feedback ? "true" : "false");
+
+	std::string json_data = "{\"description\":";
+	json_data += Json::valueToQuotedString(launchpad_trigger->description);
+	json_data += ",\"device\":";
+	json_data += Json::valueToQuotedString(launchpad_trigger->device_id);
+	json_data += fields;
+
+	return strdup(json_data.c_str());
 }
 
 void stack_launchpad_trigger_free_json(StackTrigger *trigger, char *json_data)
@@ -855,7 +3872,16 @@ void stack_launchpad_trigger_from_json(StackTrigger *trigger, const char *json_d
 	// Get the data that's pertinent to us
 	Json::Value& trigger_data = trigger_root["StackLaunchpadTrigger"];
 
+	// Remove the trigger from the index whilst we change its button. We hold
+	// the lock until it's added back so that nothing rebuilds the dispatch
+	// table with it part way through being changed. Staged triggers (i.e.
+	// those of a show that's loading) stay out of the index until the whole
+	// show has loaded
 	StackLaunchpadTrigger *launchpad_trigger = STACK_LAUNCHPAD_TRIGGER(trigger);
+	list_mutex.lock();
+	const bool staged = launchpad_trigger->staged;
+	stack_launchpad_trigger_index_remove(launchpad_trigger);
+
 	if (trigger_data.isMember("description"))
 	{
 		if (launchpad_trigger->description != NULL)
@@ -865,6 +3891,15 @@ void stack_launchpad_trigger_from_json(StackTrigger *trigger, const char *json_d
 		launchpad_trigger->description = strdup(trigger_data["description"].asString().c_str());
 	}
 
+	if (trigger_data.isMember("device"))
+	{
+		if (launchpad_trigger->device_id != NULL)
+		{
+			free(launchpad_trigger->device_id);
+		}
+		launchpad_trigger->device_id = strdup(trigger_data["device"].asString().c_str());
+	}
+
 	if (trigger_data.isMember("row"))
 	{
 		launchpad_trigger->row = trigger_data["row"].asUInt();
@@ -875,6 +3910,12 @@ void stack_launchpad_trigger_from_json(StackTrigger *trigger, const char *json_d
 		launchpad_trigger->column = trigger_data["column"].asUInt();
 	}
 
+	if (trigger_data.isMember("page"))
+	{
+		const unsigned int page = trigger_data["page"].asUInt();
+		launchpad_trigger->page = page >= 1 && page <= LAUNCHPAD_MAX_PAGES ? page : 1;
+	}
+
 	if (trigger_data.isMember("r"))
 	{
 		launchpad_trigger->r = trigger_data["r"].asUInt();
@@ -900,11 +3941,61 @@ void stack_launchpad_trigger_from_json(StackTrigger *trigger, const char *json_d
 		launchpad_trigger->use_for_cue_list = trigger_data["use_for_cue_list"].asBool();
 	}
 
-	LaunchpadDevice *device = stack_launchpad_trigger_get_device(true);
-	if (device)
+	if (trigger_data.isMember("pressure_curve"))
+	{
+		unsigned int pressure_curve = trigger_data["pressure_curve"].asUInt();
+		if (pressure_curve > LAUNCHPAD_PRESSURE_CURVE_HARD)
+		{
+			pressure_curve = LAUNCHPAD_PRESSURE_CURVE_NONE;
+		}
+		launchpad_trigger->pressure_curve = (LaunchpadPressureCurve)pressure_curve;
+	}
+
+	if (trigger_data.isMember("debounce_ms"))
+	{
+		launchpad_trigger->debounce_ms = trigger_data["debounce_ms"].asUInt();
+	}
+
+	if (trigger_data.isMember("repeat_mode"))
+	{
+		launchpad_trigger->repeat_mode = trigger_data["repeat_mode"].asUInt() == LAUNCHPAD_REPEAT_QUEUE ? LAUNCHPAD_REPEAT_QUEUE : LAUNCHPAD_REPEAT_IGNORE;
+	}
+
+	if (trigger_data.isMember("hold_repeat"))
+	{
+		launchpad_trigger->hold_repeat = trigger_data["hold_repeat"].asBool();
+	}
+
+	if (trigger_data.isMember("velocity_min") && trigger_data.isMember("velocity_max"))
+	{
+		const unsigned int velocity_min = trigger_data["velocity_min"].asUInt();
+		const unsigned int velocity_max = trigger_data["velocity_max"].asUInt();
+		if (velocity_min >= LAUNCHPAD_VELOCITY_MIN && velocity_min <= velocity_max && velocity_max <= LAUNCHPAD_VELOCITY_MAX)
+		{
+			launchpad_trigger->velocity_min = velocity_min;
+			launchpad_trigger->velocity_max = velocity_max;
+		}
+	}
+
+	if (trigger_data.isMember("playback_feedback"))
+	{
+		launchpad_trigger->playback_feedback = trigger_data["playback_feedback"].asBool();
+	}
+	stack_launchpad_trigger_update_event_text(launchpad_trigger);
+
+	// We don't open the device here as the MIDI thread does that for us
+	if (!staged)
 	{
-		stack_launchpad_trigger_add_button(device, launchpad_trigger->column, launchpad_trigger->row, launchpad_trigger->r, launchpad_trigger->g, launchpad_trigger->b);
+		stack_launchpad_trigger_index_add(launchpad_trigger);
+		LaunchpadDevice *device = stack_launchpad_trigger_get_trigger_device(launchpad_trigger);
+		if (device)
+		{
+			stack_launchpad_trigger_add_button(device, launchpad_trigger->page - 1, launchpad_trigger->column, launchpad_trigger->row, launchpad_trigger->r, launchpad_trigger->g, launchpad_trigger->b);
+		}
 	}
+	list_mutex.unlock();
+
+	stack_launchpad_trigger_watch_feedback(launchpad_trigger, launchpad_trigger->playback_feedback);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -988,6 +4079,60 @@ bool stack_launchpad_trigger_get_global_button_from_ui(GtkDialog *parent, GtkBui
 	return true;
 }
 
+// Shows the current latency measurements in the global settings dialog
+static void stack_launchpad_trigger_update_latency_ui(GtkBuilder *builder)
+{
+	char report[LAUNCHPAD_LATENCY_REPORT_SIZE];
+	stack_launchpad_trigger_latency_report(report, sizeof(report));
+
+	// Don't leave a blank line at the end
+	size_t length = strlen(report);
+	if (length > 0 && report[length - 1] == '\n')
+	{
+		report[length - 1] = '\0';
+	}
+	gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(builder, "ltgsdLatencyLabel")), report);
+}
+
+// Shows the current device statistics in the global settings dialog
+static void stack_launchpad_trigger_update_stats_ui(GtkBuilder *builder, LaunchpadStatsSnapshot *snapshot)
+{
+	char report[LAUNCHPAD_STATS_REPORT_SIZE];
+	stack_launchpad_trigger_stats_report(report, sizeof(report), snapshot);
+
+	// Don't leave a blank line at the end
+	size_t length = strlen(report);
+	if (length > 0 && report[length - 1] == '\n')
+	{
+		report[length - 1] = '\0';
+	}
+	gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(builder, "ltgsdStatsLabel")), report);
+}
+
+// Timer callback that refreshes the statistics (and the latency measurements)
+// whilst the global settings dialog is open
+static gboolean stack_launchpad_trigger_stats_timer(gpointer user_data)
+{
+	GtkBuilder *builder = GTK_BUILDER(user_data);
+	stack_launchpad_trigger_update_stats_ui(builder, (LaunchpadStatsSnapshot*)g_object_get_data(G_OBJECT(builder), "stats-snapshot"));
+	stack_launchpad_trigger_update_latency_ui(builder);
+	return G_SOURCE_CONTINUE;
+}
+
+gboolean stack_launchpad_trigger_latency_log_clicked(GtkWidget *widget, gpointer user_data)
+{
+	stack_launchpad_trigger_log_latency();
+	stack_launchpad_trigger_update_latency_ui(GTK_BUILDER(user_data));
+	return false;
+}
+
+gboolean stack_launchpad_trigger_latency_reset_clicked(GtkWidget *widget, gpointer user_data)
+{
+	stack_launchpad_trigger_reset_latency();
+	stack_launchpad_trigger_update_latency_ui(GTK_BUILDER(user_data));
+	return false;
+}
+
 gboolean stack_launchpad_trigger_global_settings_clicked(GtkWidget *widget, gpointer user_data)
 {
 	// Build the dialog
@@ -995,10 +4140,23 @@ gboolean stack_launchpad_trigger_global_settings_clicked(GtkWidget *widget, gpoi
 	GtkDialog *dialog = GTK_DIALOG(gtk_builder_get_object(builder, "launchpadTriggerGlobalSettingsDialog"));
 	gtk_window_set_transient_for(GTK_WINDOW(dialog), GTK_WINDOW(user_data));
 
+	// Callbacks
+	gtk_builder_add_callback_symbol(builder, "stack_launchpad_trigger_latency_log_clicked", G_CALLBACK(stack_launchpad_trigger_latency_log_clicked));
+	gtk_builder_add_callback_symbol(builder, "stack_launchpad_trigger_latency_reset_clicked", G_CALLBACK(stack_launchpad_trigger_latency_reset_clicked));
+	gtk_builder_connect_signals(builder, builder);
+
 	// Set up response buttons
 	gtk_dialog_add_buttons(dialog, "Cancel", 2, "OK", 1, NULL);
 	gtk_dialog_set_default_response(dialog, 1);
 
+	// Show the latency measurements so far, and keep them and the device
+	// statistics up to date whilst the dialog is open
+	stack_launchpad_trigger_update_latency_ui(builder);
+	LaunchpadStatsSnapshot stats_snapshot = {0};
+	g_object_set_data(G_OBJECT(builder), "stats-snapshot", &stats_snapshot);
+	stack_launchpad_trigger_update_stats_ui(builder, &stats_snapshot);
+	guint stats_source = g_timeout_add(LAUNCHPAD_STATS_INTERVAL_MS, stack_launchpad_trigger_stats_timer, builder);
+
 	// Set up all the buttons
 	stack_launchpad_trigger_set_global_button_ui(builder, "Up", &global_buttons[GLOBAL_BUTTON_INDEX_UP]);
 	stack_launchpad_trigger_set_global_button_ui(builder, "Down", &global_buttons[GLOBAL_BUTTON_INDEX_DOWN]);
@@ -1007,6 +4165,35 @@ gboolean stack_launchpad_trigger_global_settings_clicked(GtkWidget *widget, gpoi
 	stack_launchpad_trigger_set_global_button_ui(builder, "Go", &global_buttons[GLOBAL_BUTTON_INDEX_GO]);
 	stack_launchpad_trigger_set_global_button_ui(builder, "StopAll", &global_buttons[GLOBAL_BUTTON_INDEX_STOP_ALL]);
 
+	// Set up the MIDI thread settings. An empty CPU means any CPU
+	GtkToggleButton *ltgsdRealtimeCheck = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltgsdRealtimeCheck"));
+	GtkEntry *ltgsdCpuEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltgsdCpuEntry"));
+	GtkToggleButton *ltgsdLockMemoryCheck = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltgsdLockMemoryCheck"));
+	gtk_toggle_button_set_active(ltgsdRealtimeCheck, thread_settings.realtime);
+	stack_limit_gtk_entry_int(ltgsdCpuEntry, false);
+	if (thread_settings.cpu >= 0)
+	{
+		char buffer[16];
+		snprintf(buffer, 16, "%d", thread_settings.cpu.load());
+		gtk_entry_set_text(ltgsdCpuEntry, buffer);
+	}
+	gtk_toggle_button_set_active(ltgsdLockMemoryCheck, thread_settings.lock_memory);
+
+	// Set up the capture settings
+	GtkToggleButton *ltgsdCaptureCheck = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltgsdCaptureCheck"));
+	GtkEntry *ltgsdCaptureEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltgsdCaptureEntry"));
+	gtk_toggle_button_set_active(ltgsdCaptureCheck, capture_requested);
+	gtk_entry_set_text(ltgsdCaptureEntry, capture_filename.c_str());
+
+	// Set up the cue timing settings
+	GtkToggleButton *ltgsdScheduleCheck = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltgsdScheduleCheck"));
+	GtkEntry *ltgsdOffsetEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltgsdOffsetEntry"));
+	gtk_toggle_button_set_active(ltgsdScheduleCheck, schedule_actions);
+	stack_limit_gtk_entry_int(ltgsdOffsetEntry, false);
+	char offset_buffer[16];
+	snprintf(offset_buffer, sizeof(offset_buffer), "%u", start_offset_ms);
+	gtk_entry_set_text(ltgsdOffsetEntry, offset_buffer);
+
 	bool loop = false;
 	do
 	{
@@ -1031,16 +4218,64 @@ gboolean stack_launchpad_trigger_global_settings_clicked(GtkWidget *widget, gpoi
 				loop = true;
 			}
 
+			const char *cpu_text = gtk_entry_get_text(ltgsdCpuEntry);
+			const int new_cpu = cpu_text[0] != '\0' ? atoi(cpu_text) : -1;
+			if (!loop && new_cpu >= sysconf(_SC_NPROCESSORS_CONF))
+			{
+				GtkWidget *message_dialog = gtk_message_dialog_new(GTK_WINDOW(dialog), GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, "Invalid configuration");
+				gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(message_dialog), "CPU must be between 0 and %ld, or empty to use any CPU", sysconf(_SC_NPROCESSORS_CONF) - 1);
+				gtk_window_set_title(GTK_WINDOW(message_dialog), "Error");
+				gtk_dialog_run(GTK_DIALOG(message_dialog));
+				gtk_widget_destroy(message_dialog);
+				gtk_widget_grab_focus(GTK_WIDGET(ltgsdCpuEntry));
+				loop = true;
+			}
+
+			const bool capture = gtk_toggle_button_get_active(ltgsdCaptureCheck);
+			const char *capture_file = gtk_entry_get_text(ltgsdCaptureEntry);
+			if (!loop && capture && capture_file[0] == '\0')
+			{
+				GtkWidget *message_dialog = gtk_message_dialog_new(GTK_WINDOW(dialog), GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, "Invalid configuration");
+				gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(message_dialog), "A file must be given to capture MIDI to");
+				gtk_window_set_title(GTK_WINDOW(message_dialog), "Error");
+				gtk_dialog_run(GTK_DIALOG(message_dialog));
+				gtk_widget_destroy(message_dialog);
+				gtk_widget_grab_focus(GTK_WIDGET(ltgsdCaptureEntry));
+				loop = true;
+			}
+
+			const int offset_ms = atoi(gtk_entry_get_text(ltgsdOffsetEntry));
+			if (!loop && offset_ms > LAUNCHPAD_MAX_START_OFFSET_MS)
+			{
+				GtkWidget *message_dialog = gtk_message_dialog_new(GTK_WINDOW(dialog), GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, "Invalid configuration");
+				gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(message_dialog), "The cue start latency must be between 0 and %d ms", LAUNCHPAD_MAX_START_OFFSET_MS);
+				gtk_window_set_title(GTK_WINDOW(message_dialog), "Error");
+				gtk_dialog_run(GTK_DIALOG(message_dialog));
+				gtk_widget_destroy(message_dialog);
+				gtk_widget_grab_focus(GTK_WIDGET(ltgsdOffsetEntry));
+				loop = true;
+			}
+
 			// If everything was fine, copy the data to our global array and update
 			// the buttoms
 			if (!loop)
 			{
+				list_mutex.lock();
 				memcpy(global_buttons, new_buttons, sizeof(LaunchpadGlobalButton) * GLOBAL_BUTTON_COUNT);
-				stack_launchpad_trigger_update_buttons(stack_launchpad_trigger_get_device(true));
+				stack_launchpad_trigger_update_all_buttons();
+				list_mutex.unlock();
+
+				stack_launchpad_trigger_set_thread_settings(gtk_toggle_button_get_active(ltgsdRealtimeCheck), new_cpu, gtk_toggle_button_get_active(ltgsdLockMemoryCheck));
+				stack_launchpad_trigger_set_capture(capture, capture_file);
+				schedule_actions = gtk_toggle_button_get_active(ltgsdScheduleCheck);
+				start_offset_ms = offset_ms;
 			}
 		}
 	} while (loop);
 
+	// Stop refreshing the statistics before the dialog goes away
+	g_source_remove(stats_source);
+
 	// Destroy the dialog
 	gtk_widget_destroy(GTK_WIDGET(dialog));
 
@@ -1072,6 +4307,7 @@ bool stack_launchpad_trigger_show_config_ui(StackTrigger *trigger, GtkWidget *pa
     GtkEntry *ltdDescriptionEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltdDescriptionEntry"));
     GtkEntry *ltdColumnEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltdColumnEntry"));
     GtkEntry *ltdRowEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltdRowEntry"));
+    GtkEntry *ltdPageEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltdPageEntry"));
     GtkColorButton *ltdColorButton = GTK_COLOR_BUTTON(gtk_builder_get_object(builder, "ltdColorButton"));
     GtkToggleButton *ltdActionStop = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltdActionStop"));
     GtkToggleButton *ltdActionPause = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltdActionPause"));
@@ -1079,13 +4315,36 @@ bool stack_launchpad_trigger_show_config_ui(StackTrigger *trigger, GtkWidget *pa
     GtkToggleButton *ltdEventPress = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltdEventPress"));
     GtkToggleButton *ltdEventRelease = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltdEventRelease"));
     GtkToggleButton *ltdCueListCheck = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltdCueListCheck"));
+    GtkComboBoxText *ltdDeviceCombo = GTK_COMBO_BOX_TEXT(gtk_builder_get_object(builder, "ltdDeviceCombo"));
+    GtkComboBox *ltdPressureCombo = GTK_COMBO_BOX(gtk_builder_get_object(builder, "ltdPressureCombo"));
+    GtkEntry *ltdDebounceEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltdDebounceEntry"));
+    GtkComboBox *ltdRepeatCombo = GTK_COMBO_BOX(gtk_builder_get_object(builder, "ltdRepeatCombo"));
+    GtkToggleButton *ltdHoldCheck = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltdHoldCheck"));
+    GtkEntry *ltdVelocityMinEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltdVelocityMinEntry"));
+    GtkEntry *ltdVelocityMaxEntry = GTK_ENTRY(gtk_builder_get_object(builder, "ltdVelocityMaxEntry"));
+    GtkToggleButton *ltdFeedbackCheck = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "ltdFeedbackCheck"));
 
 	// Set helpers
 	stack_limit_gtk_entry_int(ltdColumnEntry, false);
 	stack_limit_gtk_entry_int(ltdRowEntry, false);
+	stack_limit_gtk_entry_int(ltdPageEntry, false);
+	stack_limit_gtk_entry_int(ltdDebounceEntry, false);
+	stack_limit_gtk_entry_int(ltdVelocityMinEntry, false);
+	stack_limit_gtk_entry_int(ltdVelocityMaxEntry, false);
 
 	// Set the values on the dialog
 	gtk_entry_set_text(ltdDescriptionEntry, launchpad_trigger->description);
+
+	// Offer the devices we currently know about, but allow any card ID to be
+	// typed in so that triggers can be set up for devices that aren't present
+	device_mutex.lock();
+	for (auto device : devices)
+	{
+		gtk_combo_box_text_append_text(ltdDeviceCombo, device->id);
+	}
+	device_mutex.unlock();
+	gtk_entry_set_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(ltdDeviceCombo))), launchpad_trigger->device_id);
+
 	char buffer[64];
 	if (launchpad_trigger->row != 0)
 	{
@@ -1097,6 +4356,8 @@ bool stack_launchpad_trigger_show_config_ui(StackTrigger *trigger, GtkWidget *pa
 		snprintf(buffer, 64, "%d", launchpad_trigger->row);
 		gtk_entry_set_text(ltdRowEntry, buffer);
 	}
+	snprintf(buffer, 64, "%d", launchpad_trigger->page);
+	gtk_entry_set_text(ltdPageEntry, buffer);
 	GdkRGBA rgba = {(double)launchpad_trigger->r / 255.0, (double)launchpad_trigger->g / 255.0, (double)launchpad_trigger->b / 255.0, 1.0};
 	gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(ltdColorButton), &rgba);
 
@@ -1125,6 +4386,20 @@ bool stack_launchpad_trigger_show_config_ui(StackTrigger *trigger, GtkWidget *pa
 
 	gtk_toggle_button_set_active(ltdCueListCheck, launchpad_trigger->use_for_cue_list);
 
+	snprintf(buffer, 64, "%d", (int)launchpad_trigger->pressure_curve);
+	gtk_combo_box_set_active_id(ltdPressureCombo, buffer);
+
+	snprintf(buffer, 64, "%u", launchpad_trigger->debounce_ms);
+	gtk_entry_set_text(ltdDebounceEntry, buffer);
+	snprintf(buffer, 64, "%d", (int)launchpad_trigger->repeat_mode);
+	gtk_combo_box_set_active_id(ltdRepeatCombo, buffer);
+	gtk_toggle_button_set_active(ltdHoldCheck, launchpad_trigger->hold_repeat);
+	snprintf(buffer, 64, "%d", launchpad_trigger->velocity_min);
+	gtk_entry_set_text(ltdVelocityMinEntry, buffer);
+	snprintf(buffer, 64, "%d", launchpad_trigger->velocity_max);
+	gtk_entry_set_text(ltdVelocityMaxEntry, buffer);
+	gtk_toggle_button_set_active(ltdFeedbackCheck, launchpad_trigger->playback_feedback);
+
 	bool loop;
 	do
 	{
@@ -1161,17 +4436,54 @@ bool stack_launchpad_trigger_show_config_ui(StackTrigger *trigger, GtkWidget *pa
 					continue;
 				}
 
-				// Before we update the values, remove the old button
-				LaunchpadDevice *device;
-				device = stack_launchpad_trigger_get_device(true);
-				if (device != NULL)
+				int page;
+				page = atoi(gtk_entry_get_text(ltdPageEntry));
+				if (page < 1 || page > LAUNCHPAD_MAX_PAGES)
+				{
+					GtkWidget *message_dialog = NULL;
+					message_dialog = gtk_message_dialog_new(GTK_WINDOW(parent), GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, "Invalid configuration");
+					gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(message_dialog), "Page must be between 1 and %d", LAUNCHPAD_MAX_PAGES);
+					gtk_window_set_title(GTK_WINDOW(message_dialog), "Error");
+					gtk_dialog_run(GTK_DIALOG(message_dialog));
+					gtk_widget_destroy(message_dialog);
+					continue;
+				}
+
+				int velocity_min, velocity_max;
+				velocity_min = atoi(gtk_entry_get_text(ltdVelocityMinEntry));
+				velocity_max = atoi(gtk_entry_get_text(ltdVelocityMaxEntry));
+				if (velocity_min < LAUNCHPAD_VELOCITY_MIN || velocity_max > LAUNCHPAD_VELOCITY_MAX || velocity_min > velocity_max)
+				{
+					GtkWidget *message_dialog = NULL;
+					message_dialog = gtk_message_dialog_new(GTK_WINDOW(parent), GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, "Invalid configuration");
+					gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(message_dialog), "Velocities must be between %d and %d, with the lowest first", LAUNCHPAD_VELOCITY_MIN, LAUNCHPAD_VELOCITY_MAX);
+					gtk_window_set_title(GTK_WINDOW(message_dialog), "Error");
+					gtk_dialog_run(GTK_DIALOG(message_dialog));
+					gtk_widget_destroy(message_dialog);
+					continue;
+				}
+
+				// Before we update the values, remove the old button. We hold
+				// the lock until it's added back so that nothing rebuilds the
+				// dispatch table with it part way through being changed
+				LaunchpadDevice *old_device, *device;
+				list_mutex.lock();
+				old_device = stack_launchpad_trigger_get_trigger_device(launchpad_trigger);
+				stack_launchpad_trigger_index_remove(launchpad_trigger);
+				if (old_device != NULL)
 				{
-					stack_launchpad_trigger_remove_button(device, launchpad_trigger->column, launchpad_trigger->row);
+					stack_launchpad_trigger_remove_button(old_device, launchpad_trigger->page - 1, launchpad_trigger->column, launchpad_trigger->row);
 				}
 
-				// Update the position
+				// Update the device and position
+				if (launchpad_trigger->device_id != NULL)
+				{
+					free(launchpad_trigger->device_id);
+				}
+				launchpad_trigger->device_id = strdup(gtk_entry_get_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(ltdDeviceCombo)))));
 				launchpad_trigger->column = column;
 				launchpad_trigger->row = row;
+				launchpad_trigger->page = page;
 
 				// Store the action
 				if (gtk_toggle_button_get_active(ltdActionStop))
@@ -1212,18 +4524,77 @@ bool stack_launchpad_trigger_show_config_ui(StackTrigger *trigger, GtkWidget *pa
 				old_cue_list_controls = launchpad_trigger->use_for_cue_list;
 				launchpad_trigger->use_for_cue_list = gtk_toggle_button_get_active(ltdCueListCheck);
 
+				// Store the pressure curve
+				const char *pressure_id;
+				pressure_id = gtk_combo_box_get_active_id(ltdPressureCombo);
+				launchpad_trigger->pressure_curve = pressure_id != NULL ? (LaunchpadPressureCurve)atoi(pressure_id) : LAUNCHPAD_PRESSURE_CURVE_NONE;
+
+				// Store the retrigger settings
+				const char *repeat_id;
+				launchpad_trigger->debounce_ms = (uint32_t)atoi(gtk_entry_get_text(ltdDebounceEntry));
+				repeat_id = gtk_combo_box_get_active_id(ltdRepeatCombo);
+				launchpad_trigger->repeat_mode = repeat_id != NULL ? (LaunchpadRepeatMode)atoi(repeat_id) : LAUNCHPAD_REPEAT_IGNORE;
+				launchpad_trigger->hold_repeat = gtk_toggle_button_get_active(ltdHoldCheck);
+
+				// Store the velocity zone
+				launchpad_trigger->velocity_min = velocity_min;
+				launchpad_trigger->velocity_max = velocity_max;
+				stack_launchpad_trigger_update_event_text(launchpad_trigger);
+
+				// Store the playback feedback setting, taking the current
+				// state of the cue so that it's shown once re-added
+				launchpad_trigger->playback_feedback = gtk_toggle_button_get_active(ltdFeedbackCheck);
+				launchpad_trigger->feedback_state = stack_launchpad_trigger_get_feedback_state(launchpad_trigger);
+
 				// Re-add the button
+				stack_launchpad_trigger_index_add(launchpad_trigger);
+				device = stack_launchpad_trigger_get_trigger_device(launchpad_trigger);
 				if (device != NULL)
 				{
-					stack_launchpad_trigger_add_button(device, launchpad_trigger->column, launchpad_trigger->row, launchpad_trigger->r, launchpad_trigger->g, launchpad_trigger->b);
+					stack_launchpad_trigger_add_button(device, launchpad_trigger->page - 1, launchpad_trigger->column, launchpad_trigger->row, launchpad_trigger->r, launchpad_trigger->g, launchpad_trigger->b);
 
 					// If we've toggled cue list controls. refresh the entire panel
-					if (old_cue_list_controls != launchpad_trigger->use_for_cue_list)
+					if (old_cue_list_controls != launchpad_trigger->use_for_cue_list && device == old_device)
+					{
+						stack_launchpad_trigger_update_buttons(device);
+					}
+				}
+
+				// If we've moved to a different device, both panels need a
+				// rebuild as global buttons may have been uncovered
+				if (device != old_device)
+				{
+					if (old_device != NULL)
+					{
+						stack_launchpad_trigger_update_buttons(old_device);
+					}
+					if (device != NULL)
 					{
 						stack_launchpad_trigger_update_buttons(device);
 					}
 				}
 
+				// Warn if the trigger ended up under a page button, which
+				// only happens if there's nowhere else left for them
+				int covering_page;
+				covering_page = -1;
+				if (device != NULL)
+				{
+					covering_page = stack_launchpad_trigger_get_page_button(device->dispatch.load(), launchpad_trigger->column, launchpad_trigger->row);
+				}
+				list_mutex.unlock();
+				stack_launchpad_trigger_watch_feedback(launchpad_trigger, launchpad_trigger->playback_feedback);
+
+				if (covering_page >= 0)
+				{
+					GtkWidget *message_dialog = NULL;
+					message_dialog = gtk_message_dialog_new(GTK_WINDOW(parent), GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, "Button used for page selection");
+					gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(message_dialog), "Column %d, row %d is needed to select page %d, so this trigger won't fire. Move it to another button, or free up a button on the top row or right-hand column", column, row, covering_page + 1);
+					gtk_window_set_title(GTK_WINDOW(message_dialog), "Warning");
+					gtk_dialog_run(GTK_DIALOG(message_dialog));
+					gtk_widget_destroy(message_dialog);
+				}
+
 				result = true;
 				loop = false;
 				break;
@@ -1265,8 +4636,20 @@ char *stack_launchpad_trigger_config_to_json()
 	stack_launchpad_trigger_json_populate_button(buttons["stop_all"], &global_buttons[GLOBAL_BUTTON_INDEX_STOP_ALL]);
 	config_root["global_buttons"] = buttons;
 
-	Json::StreamWriterBuilder builder;
-	std::string output = Json::writeString(builder, config_root);
+	Json::Value &thread = config_root["midi_thread"];
+	thread["realtime"] = thread_settings.realtime.load();
+	thread["cpu"] = thread_settings.cpu.load();
+	thread["lock_memory"] = thread_settings.lock_memory.load();
+
+	Json::Value &capture = config_root["capture"];
+	capture["enabled"] = capture_requested;
+	capture["file"] = capture_filename;
+
+	Json::Value &cue_timing = config_root["cue_timing"];
+	cue_timing["scheduled"] = schedule_actions;
+	cue_timing["offset_ms"] = start_offset_ms;
+
+	std::string output = Json::writeString(stack_launchpad_trigger_json_writer(), config_root);
 	return strdup(output.c_str());
 }
 
@@ -1295,6 +4678,7 @@ void stack_launchpad_trigger_config_from_json(const char *json_data)
 
 	if (config_root.isMember("global_buttons"))
 	{
+		std::lock_guard<std::mutex> lock(list_mutex);
 		Json::Value &buttons = config_root["global_buttons"];
 		stack_launchpad_trigger_populate_button_from_json(buttons, "up", &global_buttons[GLOBAL_BUTTON_INDEX_UP]);
 		stack_launchpad_trigger_populate_button_from_json(buttons, "down", &global_buttons[GLOBAL_BUTTON_INDEX_DOWN]);
@@ -1302,6 +4686,26 @@ void stack_launchpad_trigger_config_from_json(const char *json_data)
 		stack_launchpad_trigger_populate_button_from_json(buttons, "right", &global_buttons[GLOBAL_BUTTON_INDEX_RIGHT]);
 		stack_launchpad_trigger_populate_button_from_json(buttons, "go", &global_buttons[GLOBAL_BUTTON_INDEX_GO]);
 		stack_launchpad_trigger_populate_button_from_json(buttons, "stop_all", &global_buttons[GLOBAL_BUTTON_INDEX_STOP_ALL]);
+		stack_launchpad_trigger_update_all_buttons();
+	}
+
+	if (config_root.isMember("midi_thread"))
+	{
+		Json::Value &thread = config_root["midi_thread"];
+		stack_launchpad_trigger_set_thread_settings(thread.get("realtime", false).asBool(), thread.get("cpu", -1).asInt(), thread.get("lock_memory", false).asBool());
+	}
+
+	if (config_root.isMember("capture"))
+	{
+		Json::Value &capture = config_root["capture"];
+		stack_launchpad_trigger_set_capture(capture.get("enabled", false).asBool(), capture.get("file", "").asString().c_str());
+	}
+
+	if (config_root.isMember("cue_timing"))
+	{
+		Json::Value &cue_timing = config_root["cue_timing"];
+		schedule_actions = cue_timing.get("scheduled", false).asBool();
+		start_offset_ms = std::min(cue_timing.get("offset_ms", 0).asUInt(), (unsigned int)LAUNCHPAD_MAX_START_OFFSET_MS);
 	}
 }
 
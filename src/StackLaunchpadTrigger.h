@@ -4,6 +4,35 @@
 // Includes:
 #include "StackTrigger.h"
 
+// Enums: How the pressure of a button is mapped to the playback volume of the
+// cue. Values are stored in show files, so must not be renumbered
+typedef enum LaunchpadPressureCurve
+{
+	// Pressure does not change the volume
+	LAUNCHPAD_PRESSURE_CURVE_NONE = 0,
+
+	// Volume (as a linear level) is proportional to pressure
+	LAUNCHPAD_PRESSURE_CURVE_LINEAR = 1,
+
+	// Light presses are louder than with a linear curve
+	LAUNCHPAD_PRESSURE_CURVE_SOFT = 2,
+
+	// Light presses are quieter than with a linear curve
+	LAUNCHPAD_PRESSURE_CURVE_HARD = 3,
+} LaunchpadPressureCurve;
+
+// Enums: What to do with a press of a button that comes before the minimum
+// time between presses has passed. Values are stored in show files, so must
+// not be renumbered
+typedef enum LaunchpadRepeatMode
+{
+	// Ignore the press
+	LAUNCHPAD_REPEAT_IGNORE = 0,
+
+	// Trigger once the minimum time has passed
+	LAUNCHPAD_REPEAT_QUEUE = 1,
+} LaunchpadRepeatMode;
+
 typedef struct StackLaunchpadTrigger
 {
 	// Superclass
@@ -12,8 +41,16 @@ typedef struct StackLaunchpadTrigger
 	// The description for the trigger
 	char *description;
 
+	// The ID of the device the trigger is for, or an empty string to use the
+	// first device found
+	char *device_id;
+
 	uint8_t row;
 	uint8_t column;
+
+	// The page (1-based) of the device that the button is on
+	uint8_t page;
+
 	uint8_t r;
 	uint8_t g;
 	uint8_t b;
@@ -22,7 +59,39 @@ typedef struct StackLaunchpadTrigger
 	// Enable for Cue List Controls
 	bool use_for_cue_list;
 
-	// Buffer for our event text
+	// How button pressure sets the playback volume of the cue
+	LaunchpadPressureCurve pressure_curve;
+
+	// The minimum time (in milliseconds) between presses of the button
+	// triggering the cue, and what to do with presses that come sooner
+	uint32_t debounce_ms;
+	LaunchpadRepeatMode repeat_mode;
+
+	// Whether holding the button down triggers the cue again every
+	// debounce_ms (e.g. for drum rolls)
+	bool hold_repeat;
+
+	// The range of press velocities that the trigger fires for. Triggers on
+	// the same button with different ranges play different cues depending on
+	// how hard the button is hit, and all those that fire for a press are
+	// started together
+	uint8_t velocity_min;
+	uint8_t velocity_max;
+
+	// Whether the button flashes or pulses to show the state of the cue
+	bool playback_feedback;
+
+	// The cue state last shown on the button (guarded by list_mutex). Only the
+	// UI thread changes this, so it can read it without the lock
+	uint8_t feedback_state;
+
+	// Whether the trigger has been created but not yet added to the dispatch
+	// table of its device, as happens whilst a show is loading (guarded by
+	// list_mutex)
+	bool staged;
+
+	// Our event text, which is rebuilt whenever the device, button, page or
+	// velocities change so that redraws just return it
 	char event_text[48];
 } StackKeyTrigger;
 
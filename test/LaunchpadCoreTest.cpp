@@ -0,0 +1,522 @@
+// Tests of launchpad-core that don't need a device, GTK or Stack: page button
+// placement, the MIDI parser, and the LED messages built for each model. Each
+// check that fails is reported, and the exit status is non-zero if any did.
+//
+// Usage: launchpad-core-test
+
+// Includes:
+#include "../src/LaunchpadCore.h"
+#include <cstdio>
+#include <cstring>
+
+// Definitions: Reports a failed check, carrying on with the rest
+#define TEST_CHECK(condition) do { if (!(condition)) { fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #condition); test_failures++; } } while (0)
+
+// The number of checks that have failed
+static int test_failures = 0;
+
+// The positions of the default global buttons
+static const LaunchpadGlobalButton test_default_global_buttons[GLOBAL_BUTTON_COUNT] = {
+	{1, 1, 255, 255, 255}, {2, 1, 255, 255, 255}, {3, 1, 255, 255, 255},
+	{4, 1, 255, 255, 255}, {9, 9, 0, 255, 0}, {9, 6, 255, 0, 0},
+};
+
+// Stand-in for a trigger with cue list controls enabled, which is never
+// looked at
+static char test_trigger;
+
+// Sets up a dispatch table with the given number of pages and global buttons,
+// with cue list controls enabled so that the global buttons are in use
+static void stack_launchpad_test_make_table(LaunchpadDispatchTable *table, size_t page_count, const LaunchpadGlobalButton *buttons)
+{
+	table->pages.resize(page_count);
+	table->cue_list_triggers.push_back(reinterpret_cast<StackLaunchpadTrigger*>(&test_trigger));
+	memcpy(table->global_buttons, buttons, sizeof(table->global_buttons));
+	stack_launchpad_trigger_place_page_buttons(table);
+}
+
+// Checks that every page of a table has its own button, on the top row or the
+// right-hand column, that no page button is also a global button, and that
+// every global button still works on every model
+static void stack_launchpad_test_check_table(const LaunchpadDispatchTable *table)
+{
+	const size_t page_count = table->pages.size();
+	TEST_CHECK(table->page_button_count == (page_count > 1 ? page_count : 0));
+
+	for (size_t page = 0; page < table->page_button_count; page++)
+	{
+		const uint8_t column = table->page_buttons[page] % LAUNCHPAD_MAX_COLUMNS + 1;
+		const uint8_t row = table->page_buttons[page] / LAUNCHPAD_MAX_COLUMNS + 1;
+		TEST_CHECK((row == 1 && column < LAUNCHPAD_MAX_COLUMNS) || (column == LAUNCHPAD_MAX_COLUMNS && row > 1));
+		TEST_CHECK(stack_launchpad_trigger_get_page_button(table, column, row) == (int)page);
+		TEST_CHECK(stack_launchpad_trigger_get_global_button(table, column, row) == NULL);
+	}
+
+	static const char *models[] = {"Launchpad X", "Mini MK3", "Pro MK3", "MK2"};
+	for (auto model : models)
+	{
+		const LaunchpadProfile *profile = stack_launchpad_trigger_find_profile(model, "");
+		for (unsigned int address = 0; address < 128; address++)
+		{
+			LaunchpadButtonTarget target;
+			if (stack_launchpad_trigger_resolve_button(profile, table, 0, (uint8_t)address, &target))
+			{
+				TEST_CHECK(target.page_button < 0 || target.global_button == NULL);
+			}
+		}
+		for (size_t i = 0; i < GLOBAL_BUTTON_COUNT; i++)
+		{
+			TEST_CHECK(stack_launchpad_trigger_get_page_button(table, table->global_buttons[i].column, table->global_buttons[i].row) < 0);
+		}
+	}
+}
+
+// Page buttons with the default global buttons, which take the left of the
+// top row
+static void stack_launchpad_test_page_buttons()
+{
+	// A single page has no page buttons
+	LaunchpadDispatchTable one_page;
+	stack_launchpad_test_make_table(&one_page, 1, test_default_global_buttons);
+	stack_launchpad_test_check_table(&one_page);
+
+	// Up to four pages are at the right of the top row, as they always were
+	LaunchpadDispatchTable four_pages;
+	stack_launchpad_test_make_table(&four_pages, 4, test_default_global_buttons);
+	stack_launchpad_test_check_table(&four_pages);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&four_pages, 5, 1) == 0);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&four_pages, 8, 1) == 3);
+
+	// Five pages would have reached the Right button, so the last goes at the
+	// top of the right-hand column instead
+	LaunchpadDispatchTable five_pages;
+	stack_launchpad_test_make_table(&five_pages, 5, test_default_global_buttons);
+	stack_launchpad_test_check_table(&five_pages);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&five_pages, 4, 1) < 0);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&five_pages, 8, 1) == 3);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&five_pages, 9, 2) == 4);
+
+	// Eight pages would have covered all four navigation buttons
+	LaunchpadDispatchTable eight_pages;
+	stack_launchpad_test_make_table(&eight_pages, 8, test_default_global_buttons);
+	stack_launchpad_test_check_table(&eight_pages);
+	for (uint8_t column = 1; column <= 4; column++)
+	{
+		TEST_CHECK(stack_launchpad_trigger_get_page_button(&eight_pages, column, 1) < 0);
+		TEST_CHECK(stack_launchpad_trigger_get_global_button(&eight_pages, column, 1) != NULL);
+	}
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&eight_pages, 9, 5) == 7);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&eight_pages, 9, 6) < 0);
+}
+
+// Page buttons with global buttons moved to wherever page buttons could go,
+// which must still leave room for every page
+static void stack_launchpad_test_moved_global_buttons()
+{
+	// The top row and right-hand column, in the order page buttons use them
+	uint8_t columns[LAUNCHPAD_MAX_COLUMNS - 1 + LAUNCHPAD_MAX_ROWS - 1], rows[sizeof(columns)];
+	size_t count = 0;
+	for (uint8_t column = 1; column < LAUNCHPAD_MAX_COLUMNS; column++)
+	{
+		columns[count] = column;
+		rows[count++] = 1;
+	}
+	for (uint8_t row = 2; row <= LAUNCHPAD_MAX_ROWS; row++)
+	{
+		columns[count] = LAUNCHPAD_MAX_COLUMNS;
+		rows[count++] = row;
+	}
+
+	// Slide a run of global buttons along them
+	for (size_t start = 0; start + GLOBAL_BUTTON_COUNT <= count; start++)
+	{
+		LaunchpadGlobalButton buttons[GLOBAL_BUTTON_COUNT];
+		memcpy(buttons, test_default_global_buttons, sizeof(buttons));
+		for (size_t i = 0; i < GLOBAL_BUTTON_COUNT; i++)
+		{
+			buttons[i].column = columns[start + i];
+			buttons[i].row = rows[start + i];
+		}
+
+		for (size_t page_count = 1; page_count <= LAUNCHPAD_MAX_PAGES; page_count++)
+		{
+			LaunchpadDispatchTable table;
+			stack_launchpad_test_make_table(&table, page_count, buttons);
+			stack_launchpad_test_check_table(&table);
+		}
+	}
+}
+
+// Page buttons with triggers on the buttons they would have used, which the
+// page buttons move off while there is room elsewhere
+static void stack_launchpad_test_page_buttons_avoid_triggers()
+{
+	// A trigger under where the last page button would go, on a page other
+	// than the first: the page buttons shift left to make room for it
+	LaunchpadDispatchTable shifted;
+	shifted.pages.resize(2);
+	shifted.pages[1].button_triggers[stack_launchpad_trigger_button_index(8, 1)].push_back(reinterpret_cast<StackLaunchpadTrigger*>(&test_trigger));
+	stack_launchpad_test_make_table(&shifted, 2, test_default_global_buttons);
+	stack_launchpad_test_check_table(&shifted);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&shifted, 6, 1) == 0);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&shifted, 7, 1) == 1);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&shifted, 8, 1) < 0);
+
+	// Triggers across the whole top row push the page buttons down the
+	// right-hand column
+	LaunchpadDispatchTable column;
+	column.pages.resize(3);
+	for (uint8_t i = 5; i < LAUNCHPAD_MAX_COLUMNS; i++)
+	{
+		column.pages[0].button_triggers[stack_launchpad_trigger_button_index(i, 1)].push_back(reinterpret_cast<StackLaunchpadTrigger*>(&test_trigger));
+	}
+	stack_launchpad_test_make_table(&column, 3, test_default_global_buttons);
+	stack_launchpad_test_check_table(&column);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&column, 9, 2) == 0);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&column, 9, 4) == 2);
+	for (uint8_t i = 5; i < LAUNCHPAD_MAX_COLUMNS; i++)
+	{
+		TEST_CHECK(stack_launchpad_trigger_get_page_button(&column, i, 1) < 0);
+	}
+
+	// With a trigger on every button a page button could use, they go where
+	// they would have without any triggers
+	LaunchpadDispatchTable covered;
+	covered.pages.resize(4);
+	for (uint8_t i = 1; i < LAUNCHPAD_MAX_COLUMNS; i++)
+	{
+		covered.pages[3].button_triggers[stack_launchpad_trigger_button_index(i, 1)].push_back(reinterpret_cast<StackLaunchpadTrigger*>(&test_trigger));
+		covered.pages[3].button_triggers[stack_launchpad_trigger_button_index(LAUNCHPAD_MAX_COLUMNS, i + 1)].push_back(reinterpret_cast<StackLaunchpadTrigger*>(&test_trigger));
+	}
+	stack_launchpad_test_make_table(&covered, 4, test_default_global_buttons);
+	stack_launchpad_test_check_table(&covered);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&covered, 5, 1) == 0);
+	TEST_CHECK(stack_launchpad_trigger_get_page_button(&covered, 8, 1) == 3);
+}
+
+// Feeds bytes to a parser as one read, returning the number of messages parsed
+// (of at most max_messages)
+static size_t stack_launchpad_test_parse(LaunchpadMidiParser *parser, const uint8_t *data, size_t length, LaunchpadMidiMessage *messages, size_t max_messages)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < length; i++)
+	{
+		LaunchpadMidiMessage message;
+		if (stack_launchpad_trigger_parse_byte(parser, data[i], &message) && count < max_messages)
+		{
+			messages[count++] = message;
+		}
+	}
+
+	return count;
+}
+
+// Returns whether a parsed message is the given one
+static bool stack_launchpad_test_message_is(const LaunchpadMidiMessage &message, uint8_t status, uint8_t data0, uint8_t data1)
+{
+	return message.status == status && message.data[0] == data0 && message.data[1] == data1;
+}
+
+// Running status: data bytes without a status byte of their own carry on the
+// last one
+static void stack_launchpad_test_parser_running_status()
+{
+	static const uint8_t data[] = {0x90, 0x0b, 0x7f, 0x0c, 0x40, 0xb0, 0x5b, 0x7f, 0x5b, 0x00};
+	LaunchpadMidiParser parser;
+	stack_launchpad_trigger_parser_reset(&parser);
+	LaunchpadMidiMessage messages[8];
+	TEST_CHECK(stack_launchpad_test_parse(&parser, data, sizeof(data), messages, 8) == 4);
+	TEST_CHECK(stack_launchpad_test_message_is(messages[0], MIDI_NOTE_ON, 0x0b, 0x7f));
+	TEST_CHECK(stack_launchpad_test_message_is(messages[1], MIDI_NOTE_ON, 0x0c, 0x40));
+	TEST_CHECK(stack_launchpad_test_message_is(messages[2], MIDI_CONTROL_CHANGE, 0x5b, 0x7f));
+	TEST_CHECK(stack_launchpad_test_message_is(messages[3], MIDI_CONTROL_CHANGE, 0x5b, 0x00));
+	TEST_CHECK(parser.incomplete_count == 0);
+}
+
+// A message split across two reads, as happens when a read ends part way
+// through one, including part way through a running status message
+static void stack_launchpad_test_parser_split_read()
+{
+	static const uint8_t first[] = {0x90, 0x0b};
+	static const uint8_t second[] = {0x7f, 0x0c};
+	static const uint8_t third[] = {0x00};
+	LaunchpadMidiParser parser;
+	stack_launchpad_trigger_parser_reset(&parser);
+	LaunchpadMidiMessage messages[4];
+	TEST_CHECK(stack_launchpad_test_parse(&parser, first, sizeof(first), messages, 4) == 0);
+	TEST_CHECK(stack_launchpad_test_parse(&parser, second, sizeof(second), messages, 4) == 1);
+	TEST_CHECK(stack_launchpad_test_message_is(messages[0], MIDI_NOTE_ON, 0x0b, 0x7f));
+	TEST_CHECK(stack_launchpad_test_parse(&parser, third, sizeof(third), messages, 4) == 1);
+	TEST_CHECK(stack_launchpad_test_message_is(messages[0], MIDI_NOTE_ON, 0x0c, 0x00));
+	TEST_CHECK(parser.incomplete_count == 0);
+}
+
+// Real-time bytes in the middle of a message, and a SysEx reply from the
+// device (with real-time bytes in it too), are all skipped. The SysEx reply
+// cancels the running status, so data after it with no status is skipped too
+static void stack_launchpad_test_parser_sysex_and_real_time()
+{
+	static const uint8_t data[] = {
+		0x90, 0x0b, 0xf8, 0x7f,
+		0xf0, 0x00, 0x20, 0xfe, 0x29, 0x02, 0x0c, 0x0e, 0x01, 0xf7,
+		0x0c, 0x40,
+		0xb0, 0xfa, 0x5b, 0xfc, 0x7f,
+	};
+	LaunchpadMidiParser parser;
+	stack_launchpad_trigger_parser_reset(&parser);
+	LaunchpadMidiMessage messages[8];
+	TEST_CHECK(stack_launchpad_test_parse(&parser, data, sizeof(data), messages, 8) == 2);
+	TEST_CHECK(stack_launchpad_test_message_is(messages[0], MIDI_NOTE_ON, 0x0b, 0x7f));
+	TEST_CHECK(stack_launchpad_test_message_is(messages[1], MIDI_CONTROL_CHANGE, 0x5b, 0x7f));
+	TEST_CHECK(parser.incomplete_count == 0);
+}
+
+// A message cut short by another status byte is dropped and counted, and the
+// new message is parsed as normal
+static void stack_launchpad_test_parser_incomplete()
+{
+	static const uint8_t data[] = {0x90, 0x0b, 0xb0, 0x5b, 0x7f, 0x5c, 0xf0, 0x00, 0xf7, 0x80, 0x0b, 0x40};
+	LaunchpadMidiParser parser;
+	stack_launchpad_trigger_parser_reset(&parser);
+	LaunchpadMidiMessage messages[8];
+	TEST_CHECK(stack_launchpad_test_parse(&parser, data, sizeof(data), messages, 8) == 2);
+	TEST_CHECK(stack_launchpad_test_message_is(messages[0], MIDI_CONTROL_CHANGE, 0x5b, 0x7f));
+	TEST_CHECK(stack_launchpad_test_message_is(messages[1], MIDI_NOTE_OFF, 0x0b, 0x40));
+	TEST_CHECK(parser.incomplete_count == 2);
+}
+
+// Note offs are releases whatever their velocity, as are note ons with none,
+// and only notes and controller changes are buttons
+static void stack_launchpad_test_button_pressure()
+{
+	uint8_t pressure = 0xff;
+	const LaunchpadMidiMessage note_off = {MIDI_NOTE_OFF, {0x0b, 0x40}};
+	TEST_CHECK(stack_launchpad_trigger_button_pressure(&note_off, &pressure) && pressure == 0);
+
+	pressure = 0xff;
+	const LaunchpadMidiMessage note_on_release = {MIDI_NOTE_ON, {0x0b, 0x00}};
+	TEST_CHECK(stack_launchpad_trigger_button_pressure(&note_on_release, &pressure) && pressure == 0);
+
+	const LaunchpadMidiMessage note_on = {MIDI_NOTE_ON, {0x0b, 0x64}};
+	TEST_CHECK(stack_launchpad_trigger_button_pressure(&note_on, &pressure) && pressure == 0x64);
+
+	const LaunchpadMidiMessage control_change = {MIDI_CONTROL_CHANGE, {0x5b, 0x7f}};
+	TEST_CHECK(stack_launchpad_trigger_button_pressure(&control_change, &pressure) && pressure == 0x7f);
+
+	const LaunchpadMidiMessage aftertouch = {MIDI_POLY_AFTERTOUCH, {0x0b, 0x40}};
+	TEST_CHECK(!stack_launchpad_trigger_button_pressure(&aftertouch, &pressure));
+}
+
+// Starts a set of LEDs that have never been sent to the device
+static void stack_launchpad_test_reset_leds(LaunchpadLeds *leds)
+{
+	memset(leds, 0, sizeof(LaunchpadLeds));
+	for (size_t i = 0; i < LAUNCHPAD_MAX_BUTTONS; i++)
+	{
+		leds->sent[i].mode = LAUNCHPAD_LED_UNKNOWN;
+	}
+}
+
+// Lights an LED and marks it to be sent
+static void stack_launchpad_test_light(LaunchpadLeds *leds, uint8_t column, uint8_t row, uint8_t mode, uint8_t r, uint8_t g, uint8_t b)
+{
+	const int index = stack_launchpad_trigger_button_index(column, row);
+	stack_launchpad_trigger_light_led(leds, index, mode, r, g, b);
+	leds->dirty[index] = true;
+}
+
+// Returns whether encoded LEDs are exactly the given messages, printing what
+// they were if not
+static bool stack_launchpad_test_output_is(const LaunchpadLedOutput &output, const uint8_t *short_data, size_t short_length, size_t short_messages, const uint8_t *sysex_data, size_t sysex_length)
+{
+	if (output.short_length == short_length && output.short_messages == short_messages && output.sysex_length == sysex_length &&
+	    (short_length == 0 || memcmp(output.short_data, short_data, short_length) == 0) && (sysex_length == 0 || memcmp(output.sysex_data, sysex_data, sysex_length) == 0))
+	{
+		return true;
+	}
+
+	fprintf(stderr, "Short (%zu messages):", output.short_messages);
+	for (size_t i = 0; i < output.short_length; i++)
+	{
+		fprintf(stderr, " %02x", output.short_data[i]);
+	}
+	fprintf(stderr, "\nSysEx:");
+	for (size_t i = 0; i < output.sysex_length; i++)
+	{
+		fprintf(stderr, " %02x", output.sysex_data[i]);
+	}
+	fprintf(stderr, "\n");
+	return false;
+}
+
+// The LED messages for the models with typed SysEx entries, which only differ
+// in their SysEx header. As palette colours are one byte cheaper per LED in
+// SysEx, but the SysEx message has a fixed cost of nine, nine static palette
+// LEDs tie and go in a single SysEx message, whilst eight go as notes
+static void stack_launchpad_test_encode_typed(const char *model, uint8_t device_id)
+{
+	const LaunchpadProfile *profile = stack_launchpad_trigger_find_profile(model, "");
+	LaunchpadLeds leds;
+	LaunchpadLedOutput output;
+
+	// A static palette colour is a note on channel 1, and isn't sent again
+	// once sent
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 2, 8, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	static const uint8_t static_short[] = {0x90, 0x16, 0x05};
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 1);
+	TEST_CHECK(stack_launchpad_test_output_is(output, static_short, sizeof(static_short), 1, NULL, 0));
+	leds.dirty[stack_launchpad_trigger_button_index(2, 8)] = true;
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 0);
+	TEST_CHECK(stack_launchpad_test_output_is(output, NULL, 0, 0, NULL, 0));
+
+	// Flashing on the top row is a CC turning the static colour off on
+	// channel 1, then the flash colour on channel 2
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 3, 1, LAUNCHPAD_LED_FLASH, 0, 255, 0);
+	static const uint8_t flash_short[] = {0xb0, 0x5d, 0x00, 0xb1, 0x5d, 0x15};
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 1);
+	TEST_CHECK(stack_launchpad_test_output_is(output, flash_short, sizeof(flash_short), 2, NULL, 0));
+
+	// A colour outside the palette is an RGB entry with 7-bit components
+	const uint8_t rgb_sysex[] = {0xf0, 0x00, 0x20, 0x29, 0x02, device_id, 0x03, 0x03, 0x16, 0x64, 0x32, 0x05, 0xf7};
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 2, 8, LAUNCHPAD_LED_STATIC, 200, 100, 10);
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 1);
+	TEST_CHECK(stack_launchpad_test_output_is(output, NULL, 0, 0, rgb_sysex, sizeof(rgb_sysex)));
+
+	// Once there is a SysEx message for an RGB LED, palette LEDs are cheaper
+	// in it than as notes
+	const uint8_t mixed_sysex[] = {0xf0, 0x00, 0x20, 0x29, 0x02, device_id, 0x03, 0x03, 0x16, 0x64, 0x32, 0x05, 0x00, 0x17, 0x05, 0xf7};
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 2, 8, LAUNCHPAD_LED_STATIC, 200, 100, 10);
+	stack_launchpad_test_light(&leds, 3, 8, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 2);
+	TEST_CHECK(stack_launchpad_test_output_is(output, NULL, 0, 0, mixed_sysex, sizeof(mixed_sysex)));
+
+	// Eight static palette LEDs (notes 21 to 28) as notes
+	static const uint8_t eight_short[] = {
+		0x90, 0x15, 0x05, 0x90, 0x16, 0x05, 0x90, 0x17, 0x05, 0x90, 0x18, 0x05,
+		0x90, 0x19, 0x05, 0x90, 0x1a, 0x05, 0x90, 0x1b, 0x05, 0x90, 0x1c, 0x05,
+	};
+	stack_launchpad_test_reset_leds(&leds);
+	for (uint8_t column = 1; column <= 8; column++)
+	{
+		stack_launchpad_test_light(&leds, column, 8, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	}
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 8);
+	TEST_CHECK(stack_launchpad_test_output_is(output, eight_short, sizeof(eight_short), 8, NULL, 0));
+
+	// A ninth (note 31, which comes first as it is higher up the grid) ties,
+	// and goes with the rest in one SysEx message
+	const uint8_t nine_sysex[] = {
+		0xf0, 0x00, 0x20, 0x29, 0x02, device_id, 0x03,
+		0x00, 0x1f, 0x05, 0x00, 0x15, 0x05, 0x00, 0x16, 0x05, 0x00, 0x17, 0x05, 0x00, 0x18, 0x05,
+		0x00, 0x19, 0x05, 0x00, 0x1a, 0x05, 0x00, 0x1b, 0x05, 0x00, 0x1c, 0x05,
+		0xf7,
+	};
+	stack_launchpad_test_reset_leds(&leds);
+	for (uint8_t column = 1; column <= 8; column++)
+	{
+		stack_launchpad_test_light(&leds, column, 8, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	}
+	stack_launchpad_test_light(&leds, 1, 7, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 9);
+	TEST_CHECK(stack_launchpad_test_output_is(output, NULL, 0, 0, nine_sysex, sizeof(nine_sysex)));
+
+	// A flashing LED and five static ones also tie. In SysEx the flash is a
+	// typed entry flashing between the colour and off
+	const uint8_t flash_tie_sysex[] = {
+		0xf0, 0x00, 0x20, 0x29, 0x02, device_id, 0x03,
+		0x01, 0x5d, 0x15, 0x00,
+		0x00, 0x15, 0x05, 0x00, 0x16, 0x05, 0x00, 0x17, 0x05, 0x00, 0x18, 0x05, 0x00, 0x19, 0x05,
+		0xf7,
+	};
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 3, 1, LAUNCHPAD_LED_FLASH, 0, 255, 0);
+	for (uint8_t column = 1; column <= 5; column++)
+	{
+		stack_launchpad_test_light(&leds, column, 8, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	}
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 6);
+	TEST_CHECK(stack_launchpad_test_output_is(output, NULL, 0, 0, flash_tie_sysex, sizeof(flash_tie_sysex)));
+}
+
+// The LED messages for the MK2, which has no typed SysEx entries, so palette
+// colours are always notes and CCs, and its RGB entries take 6-bit components
+static void stack_launchpad_test_encode_mk2()
+{
+	const LaunchpadProfile *profile = stack_launchpad_trigger_find_profile("MK2", "");
+	LaunchpadLeds leds;
+	LaunchpadLedOutput output;
+
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 2, 8, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	static const uint8_t static_short[] = {0x90, 0x16, 0x05};
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 1);
+	TEST_CHECK(stack_launchpad_test_output_is(output, static_short, sizeof(static_short), 1, NULL, 0));
+
+	// The top row is CCs 104 to 111
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 3, 1, LAUNCHPAD_LED_FLASH, 0, 255, 0);
+	static const uint8_t flash_short[] = {0xb0, 0x6a, 0x00, 0xb1, 0x6a, 0x15};
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 1);
+	TEST_CHECK(stack_launchpad_test_output_is(output, flash_short, sizeof(flash_short), 2, NULL, 0));
+
+	static const uint8_t rgb_sysex[] = {0xf0, 0x00, 0x20, 0x29, 0x02, 0x18, 0x0b, 0x16, 0x32, 0x19, 0x02, 0xf7};
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 2, 8, LAUNCHPAD_LED_STATIC, 200, 100, 10);
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 1);
+	TEST_CHECK(stack_launchpad_test_output_is(output, NULL, 0, 0, rgb_sysex, sizeof(rgb_sysex)));
+
+	// Palette LEDs stay as notes alongside the SysEx message for RGB LEDs
+	static const uint8_t mixed_short[] = {0x90, 0x17, 0x05};
+	stack_launchpad_test_reset_leds(&leds);
+	stack_launchpad_test_light(&leds, 2, 8, LAUNCHPAD_LED_STATIC, 200, 100, 10);
+	stack_launchpad_test_light(&leds, 3, 8, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 2);
+	TEST_CHECK(stack_launchpad_test_output_is(output, mixed_short, sizeof(mixed_short), 1, rgb_sysex, sizeof(rgb_sysex)));
+
+	// Nine static palette LEDs, which tie on the other models, are still
+	// notes
+	static const uint8_t nine_short[] = {
+		0x90, 0x1f, 0x05,
+		0x90, 0x15, 0x05, 0x90, 0x16, 0x05, 0x90, 0x17, 0x05, 0x90, 0x18, 0x05,
+		0x90, 0x19, 0x05, 0x90, 0x1a, 0x05, 0x90, 0x1b, 0x05, 0x90, 0x1c, 0x05,
+	};
+	stack_launchpad_test_reset_leds(&leds);
+	for (uint8_t column = 1; column <= 8; column++)
+	{
+		stack_launchpad_test_light(&leds, column, 8, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	}
+	stack_launchpad_test_light(&leds, 1, 7, LAUNCHPAD_LED_STATIC, 255, 0, 0);
+	TEST_CHECK(profile->encode_leds(&leds, &output) == 9);
+	TEST_CHECK(stack_launchpad_test_output_is(output, nine_short, sizeof(nine_short), 9, NULL, 0));
+}
+
+int main()
+{
+	stack_launchpad_test_page_buttons();
+	stack_launchpad_test_moved_global_buttons();
+	stack_launchpad_test_page_buttons_avoid_triggers();
+
+	stack_launchpad_test_parser_running_status();
+	stack_launchpad_test_parser_split_read();
+	stack_launchpad_test_parser_sysex_and_real_time();
+	stack_launchpad_test_parser_incomplete();
+	stack_launchpad_test_button_pressure();
+
+	stack_launchpad_test_encode_typed("Launchpad X", 0x0c);
+	stack_launchpad_test_encode_typed("Mini MK3", 0x0d);
+	stack_launchpad_test_encode_typed("Pro MK3", 0x0e);
+	stack_launchpad_test_encode_mk2();
+
+	if (test_failures > 0)
+	{
+		fprintf(stderr, "%d checks failed\n", test_failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}